@@ -1,4 +1,5 @@
 #include "../lib/util.hpp"
+#include "../lib/os.hpp"
 #include <cstdio>
 #include <stdlib.h>
 
@@ -16,14 +17,15 @@ UInt64 get_bit_count(UInt64 x)
     return result;
 }
 
-UInt64 random64()
+// NOTE: xorshift64*, the state must not be zero
+UInt64 get_xorshift_number(UInt64 *state)
 {
-    UInt64 u1, u2, u3, u4;
-    u1 = (UInt64)(rand()) & 0xffff;
-    u2 = (UInt64)(rand()) & 0xffff;
-    u3 = (UInt64)(rand()) & 0xffff;
-    u4 = (UInt64)(rand()) & 0xffff;
-    return u1 | (u2 << 16) | (u3 << 32) | (u4 << 48);
+    UInt64 x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dull;
 }
 
 BitBoard get_square(Int row, Int column)
@@ -61,9 +63,9 @@ BitBoard get_blocker(BitBoard square, UInt64 blocker_mask, UInt64 blocker_bit_co
     return blocker;
 }
 
-UInt64 calc_hash(BitBoard blocker, UInt64 guess, UInt64 blocker_bit_count)
+UInt64 calc_hash(BitBoard blocker, UInt64 guess, UInt64 index_bit_count)
 {
-    UInt64 hash = (blocker * guess) >> (64 - blocker_bit_count);
+    UInt64 hash = (blocker * guess) >> (64 - index_bit_count);
     return hash;
 }
 
@@ -143,9 +145,13 @@ struct SlidingPiece
 {
     BitBoard blocker_mask[64];
     UInt64 blocker_bit_count[64];
-    BitBoard blocker[64][1 << 13];
-    BitBoard move[64][1 << 13];
     UInt64 magic[64];
+    // NOTE: Bits of the magic index, fewer than the blocker bits when a smaller magic was found
+    UInt64 index_bit_count[64];
+    // NOTE: Where the moves of each square start in the magic and the PEXT attack arrays, both shared by the two sliding
+    // pieces
+    UInt32 offset[64];
+    UInt32 pext_offset[64];
 
     BitBoard (*get_blocker_mask)(Int square);
     BitBoard (*get_move)(Int square, BitBoard blocker);
@@ -371,7 +377,165 @@ BitBoard get_pawn_capture(BitBoard square, Int direction)
     return result;
 }
 
+// NOTE: Must match SlidingPieceTableSquare and BitBoardTableFile in the game
+#define BIT_BOARD_TABLE_FILE_MAGIC 0x54424243
+#define BIT_BOARD_TABLE_FILE_VERSION 1
+
+struct SlidingPieceHeader
+{
+    BitBoard blocker_mask;
+    UInt64 magic;
+    UInt32 offset;
+    UInt32 shift;
+    UInt32 pext_offset;
+    UInt32 blocker_bit_count;
+};
+
+struct BitBoardTableFileHeader
+{
+    UInt32 magic;
+    UInt32 version;
+    UInt64 checksum;
+    UInt64 size;
+    UInt64 move_offset;
+    UInt64 move_count;
+    UInt64 pext_move_offset;
+    UInt64 pext_move_count;
+    UInt64 padding;
+};
+
+struct BitBoardTableFile
+{
+    BitBoardTableFileHeader header;
+    SlidingPieceHeader rook_board[64];
+    SlidingPieceHeader bishop_board[64];
+    BitBoard knight_move[64];
+    BitBoard king_move[64];
+};
+
+UInt64 get_checksum(const UInt8 *data, Int count)
+{
+    UInt64 checksum = 0xcbf29ce484222325ull;
+    for (Int i = 0; i + 8 <= count; i += 8)
+    {
+        checksum = (checksum ^ *(UInt64 *)(data + i)) * 0x100000001b3ull;
+    }
+    return checksum;
+}
+
+struct MagicSearch
+{
+    Int piece_type;
+    Int square;
+    UInt64 blocker_bit_count;
+    BitBoard blocker[1 << 12];
+    BitBoard move[1 << 12];
+    UInt64 random_state;
+
+    UInt64 magic;
+    UInt64 index_bit_count;
+    UInt64 guess_count;
+    Real64 time;
+};
+
+struct MagicSearcher
+{
+    MagicSearch searches[128];
+    Int next_search;
+    Int reduce_attempt_count;
+    Void *lock;
+    Void *finish_semaphore;
+};
+
+// NOTE: Slots of the collision table belong to the current guess only when tagged with the current epoch, so nothing has
+// to be cleared between guesses
+struct MagicWorker
+{
+    MagicSearcher *searcher;
+    UInt32 epoch;
+    UInt32 slot_epoch[1 << 12];
+    BitBoard slot_move[1 << 12];
+};
+
+// NOTE: Two blockers may share an index when they have the same moves, max_guess_count 0 keeps guessing until it succeeds
+Bool try_magic(MagicWorker *worker, MagicSearch *search, UInt64 index_bit_count, UInt64 max_guess_count, UInt64 *magic)
+{
+    Int blocker_count = 1 << search->blocker_bit_count;
+    for (UInt64 guess_i = 0; !max_guess_count || guess_i < max_guess_count; guess_i++)
+    {
+        UInt64 guess = get_xorshift_number(&search->random_state) & get_xorshift_number(&search->random_state) & get_xorshift_number(&search->random_state);
+        search->guess_count++;
+
+        worker->epoch++;
+        if (worker->epoch == 0)
+        {
+            memset(worker->slot_epoch, 0, sizeof(worker->slot_epoch));
+            worker->epoch = 1;
+        }
+
+        Bool success = true;
+        for (Int blocker_i = 0; blocker_i < blocker_count; blocker_i++)
+        {
+            UInt64 hash = calc_hash(search->blocker[blocker_i], guess, index_bit_count);
+            if (worker->slot_epoch[hash] != worker->epoch)
+            {
+                worker->slot_epoch[hash] = worker->epoch;
+                worker->slot_move[hash] = search->move[blocker_i];
+            }
+            else if (worker->slot_move[hash] != search->move[blocker_i])
+            {
+                success = false;
+                break;
+            }
+        }
+
+        if (success)
+        {
+            *magic = guess;
+            return true;
+        }
+    }
+    return false;
+}
+
+Void find_magic(MagicWorker *worker, MagicSearch *search)
+{
+    UInt64 timestamp = get_current_timestamp();
+    search->index_bit_count = search->blocker_bit_count;
+    ASSERT(try_magic(worker, search, search->index_bit_count, 0, &search->magic));
+
+    UInt64 magic;
+    while (worker->searcher->reduce_attempt_count && search->index_bit_count > 1 &&
+           try_magic(worker, search, search->index_bit_count - 1, worker->searcher->reduce_attempt_count, &magic))
+    {
+        search->index_bit_count--;
+        search->magic = magic;
+    }
+    search->time = get_elapsed_time(get_current_timestamp() - timestamp);
+}
+
+Void run_magic_worker(MagicWorker *worker)
+{
+    MagicSearcher *searcher = worker->searcher;
+    while (true)
+    {
+        ASSERT(down_semaphore(searcher->lock));
+        Int search_i = searcher->next_search++;
+        ASSERT(up_semaphore(searcher->lock, 1));
+        if (search_i >= 128)
+        {
+            break;
+        }
+        find_magic(worker, &searcher->searches[search_i]);
+    }
+    ASSERT(up_semaphore(searcher->finish_semaphore, 1));
+}
+
 SlidingPiece sliding_pieces[2];
+MagicSearcher magic_searcher;
+BitBoard *sliding_move;
+UInt64 sliding_move_count;
+UInt64 sliding_pext_move_count;
 BitBoard rook[64];
 BitBoard bishop[64];
 BitBoard knight[64];
@@ -381,7 +545,7 @@ Pawn pawns[2];
 int main(Int argc, CStr *argv)
 {
     argc--, argv++;
-    ASSERT(argc == 1);
+    ASSERT(argc == 1 || argc == 2);
     CStr output_filename = argv[0];
 
     sliding_pieces[0].get_blocker_mask = get_rook_blocker_mask;
@@ -389,58 +553,102 @@ int main(Int argc, CStr *argv)
     sliding_pieces[1].get_blocker_mask = get_bishop_blocker_mask;
     sliding_pieces[1].get_move = get_bishop_move;
 
-    for (Int square = 0; square < 64; square++)
+    // NOTE: With an attempt count, every square also tries that many guesses for each index bit it could drop
+    magic_searcher.reduce_attempt_count = argc == 2 ? atoi(argv[1]) : 0;
+    magic_searcher.lock = create_semaphore(1);
+    magic_searcher.finish_semaphore = create_semaphore(0);
+    ASSERT(magic_searcher.lock && magic_searcher.finish_semaphore);
+
+    // NOTE: Each square seeds its own generator so the result does not depend on which worker picks it up
+    for (Int piece_type = 0; piece_type <= 1; piece_type++)
     {
-        for (Int piece_type = 0; piece_type <= 1; piece_type++)
+        for (Int square = 0; square < 64; square++)
         {
             SlidingPiece *sliding_piece = &sliding_pieces[piece_type];
+            MagicSearch *search = &magic_searcher.searches[piece_type * 64 + square];
 
             BitBoard blocker_mask = sliding_piece->get_blocker_mask(square);
             sliding_piece->blocker_mask[square] = blocker_mask;
 
             UInt64 blocker_bit_count = get_bit_count(blocker_mask);
             sliding_piece->blocker_bit_count[square] = blocker_bit_count;
-
-            UInt64 blocker_count = 1 << blocker_bit_count;
-            for (Int blocker_i = 0; blocker_i < (Int)blocker_count; blocker_i++)
+            ASSERT(blocker_bit_count <= 12);
+
+            search->piece_type = piece_type;
+            search->square = square;
+            search->blocker_bit_count = blocker_bit_count;
+            search->random_state = 0x9e3779b97f4a7c15ull * (piece_type * 64 + square + 1);
+            Int blocker_count = 1 << blocker_bit_count;
+            for (Int blocker_i = 0; blocker_i < blocker_count; blocker_i++)
             {
                 BitBoard blocker = get_blocker(square, blocker_mask, blocker_bit_count, blocker_i);
-                sliding_piece->blocker[square][blocker_i] = blocker;
+                search->blocker[blocker_i] = blocker;
+                search->move[blocker_i] = sliding_piece->get_move(square, blocker);
             }
+        }
+    }
 
-            while (true)
-            {
-                UInt64 guess = random64() & random64() & random64();
-                Bool success = true;
-                Bool used[1 << 13];
-                memset(used, 0, sizeof(used));
-                for (Int blocker_i = 0; blocker_i < (Int)blocker_count; blocker_i++)
-                {
-                    BitBoard blocker = sliding_piece->blocker[square][blocker_i];
-                    UInt64 hash = calc_hash(blocker, guess, blocker_bit_count);
-                    if (used[hash])
-                    {
-                        success = false;
-                        break;
-                    }
-                    used[hash] = 1;
-                }
-
-                if (success)
-                {
-                    for (Int blocker_i = 0; blocker_i < (Int)blocker_count; blocker_i++)
-                    {
-                        BitBoard blocker = sliding_piece->blocker[square][blocker_i];
-                        UInt64 hash = calc_hash(blocker, guess, blocker_bit_count);
-                        BitBoard move = sliding_piece->get_move(square, blocker);
-                        sliding_piece->move[square][hash] = move;
-                    }
-                    sliding_piece->magic[square] = guess;
-                    break;
-                }
-            }
+    UInt64 timestamp = get_current_timestamp();
+    Int thread_count = MIN(get_processor_count(), 128);
+    for (Int thread_i = 0; thread_i < thread_count; thread_i++)
+    {
+        MagicWorker *worker = (MagicWorker *)malloc(sizeof(MagicWorker));
+        memset(worker, 0, sizeof(MagicWorker));
+        worker->searcher = &magic_searcher;
+        ASSERT(run_thread((ThreadFunc)run_magic_worker, worker));
+    }
+    for (Int thread_i = 0; thread_i < thread_count; thread_i++)
+    {
+        ASSERT(down_semaphore(magic_searcher.finish_semaphore));
+    }
+    Real64 time = get_elapsed_time(get_current_timestamp() - timestamp);
+
+    // NOTE: Lay out the rook squares and then the bishop squares back to back in one array
+    Real64 max_search_time = 0;
+    UInt64 guess_count = 0;
+    Int reduced_count = 0;
+    for (Int search_i = 0; search_i < 128; search_i++)
+    {
+        MagicSearch *search = &magic_searcher.searches[search_i];
+        SlidingPiece *sliding_piece = &sliding_pieces[search->piece_type];
+        sliding_piece->magic[search->square] = search->magic;
+        sliding_piece->index_bit_count[search->square] = search->index_bit_count;
+        sliding_piece->offset[search->square] = (UInt32)sliding_move_count;
+        sliding_piece->pext_offset[search->square] = (UInt32)sliding_pext_move_count;
+        sliding_move_count += 1ull << search->index_bit_count;
+        sliding_pext_move_count += 1ull << search->blocker_bit_count;
+
+        max_search_time = MAX(max_search_time, search->time);
+        guess_count += search->guess_count;
+        if (search->index_bit_count < search->blocker_bit_count)
+        {
+            reduced_count++;
+            printf("%s %c%c: %llu index bits instead of %llu, %.3fs\n", search->piece_type == 0 ? "rook" : "bishop", 'a' + search->square % 8, '1' + search->square / 8,
+                   (unsigned long long)search->index_bit_count, (unsigned long long)search->blocker_bit_count, search->time);
+        }
+    }
+
+    sliding_move = (BitBoard *)malloc(sizeof(BitBoard) * sliding_move_count);
+    memset(sliding_move, 0, sizeof(BitBoard) * sliding_move_count);
+    for (Int search_i = 0; search_i < 128; search_i++)
+    {
+        MagicSearch *search = &magic_searcher.searches[search_i];
+        SlidingPiece *sliding_piece = &sliding_pieces[search->piece_type];
+        Int blocker_count = 1 << search->blocker_bit_count;
+        for (Int blocker_i = 0; blocker_i < blocker_count; blocker_i++)
+        {
+            UInt64 hash = calc_hash(search->blocker[blocker_i], search->magic, search->index_bit_count);
+            sliding_move[sliding_piece->offset[search->square] + hash] = search->move[blocker_i];
         }
+    }
 
+    printf("%d threads, %.3fs, slowest square %.3fs, %llu guesses\n", thread_count, time, max_search_time, (unsigned long long)guess_count);
+    printf("%d reduced squares, attack array %llu entries (%llu KB), PEXT array %llu entries (%llu KB)\n", reduced_count,
+           (unsigned long long)sliding_move_count, (unsigned long long)(sliding_move_count * sizeof(BitBoard) / 1024),
+           (unsigned long long)sliding_pext_move_count, (unsigned long long)(sliding_pext_move_count * sizeof(BitBoard) / 1024));
+
+    for (Int square = 0; square < 64; square++)
+    {
         rook[square] = get_rook_move(square, 0);
         knight[square] = get_knight_move(square);
         bishop[square] = get_bishop_move(square, 0);
@@ -451,40 +659,60 @@ int main(Int argc, CStr *argv)
         pawns[1].capture[square] = get_pawn_capture(square, -1);
     }
 
-    FILE *output_file = fopen(output_filename, "wb");
-    ASSERT(fseek(output_file, 0, SEEK_SET) == 0);
+    UInt64 move_offset = align_up(sizeof(BitBoardTableFile), 64);
+    UInt64 pext_move_offset = align_up(move_offset + sizeof(BitBoard) * sliding_move_count, 64);
+    UInt64 size = pext_move_offset + sizeof(BitBoard) * sliding_pext_move_count;
+    UInt8 *data = (UInt8 *)malloc(size);
+    memset(data, 0, size);
 
-    for (Int square = 0; square < 64; square++)
+    BitBoardTableFile *file = (BitBoardTableFile *)data;
+    file->header.magic = BIT_BOARD_TABLE_FILE_MAGIC;
+    file->header.version = BIT_BOARD_TABLE_FILE_VERSION;
+    file->header.size = size;
+    file->header.move_offset = move_offset;
+    file->header.move_count = sliding_move_count;
+    file->header.pext_move_offset = pext_move_offset;
+    file->header.pext_move_count = sliding_pext_move_count;
+
+    for (Int piece_type = 0; piece_type <= 1; piece_type++)
     {
-        ASSERT(fwrite(&sliding_pieces[0].blocker_mask[square], sizeof(UInt64), 1, output_file) == 1);
-        ASSERT(fwrite(&sliding_pieces[0].blocker_bit_count[square], sizeof(UInt64), 1, output_file) == 1);
-        ASSERT(fwrite(&sliding_pieces[0].magic[square], sizeof(UInt64), 1, output_file) == 1);
-        Int blocker_count = 1 << sliding_pieces[0].blocker_bit_count[square];
-        for (Int blocker_i = 0; blocker_i < blocker_count; blocker_i++)
+        SlidingPiece *sliding_piece = &sliding_pieces[piece_type];
+        SlidingPieceHeader *board = piece_type == 0 ? file->rook_board : file->bishop_board;
+        for (Int square = 0; square < 64; square++)
         {
-            ASSERT(fwrite(&sliding_pieces[0].move[square][blocker_i], sizeof(UInt64), 1, output_file) == 1);
+            SlidingPieceHeader *header = &board[square];
+            header->blocker_mask = sliding_piece->blocker_mask[square];
+            header->magic = sliding_piece->magic[square];
+            header->offset = sliding_piece->offset[square];
+            header->shift = (UInt32)(64 - sliding_piece->index_bit_count[square]);
+            header->pext_offset = sliding_piece->pext_offset[square];
+            header->blocker_bit_count = (UInt32)sliding_piece->blocker_bit_count[square];
         }
     }
+    memcpy(file->knight_move, knight, sizeof(file->knight_move));
+    memcpy(file->king_move, king, sizeof(file->king_move));
+    memcpy(data + move_offset, sliding_move, sizeof(BitBoard) * sliding_move_count);
 
-    for (Int square = 0; square < 64; square++)
-    {
-        ASSERT(fwrite(&knight[square], sizeof(UInt64), 1, output_file) == 1);
-    }
-
-    for (Int square = 0; square < 64; square++)
+    // NOTE: Blockers are enumerated in PEXT order, blocker i has the mask bits of i scattered into it
+    BitBoard *pext_move = (BitBoard *)(data + pext_move_offset);
+    for (Int search_i = 0; search_i < 128; search_i++)
     {
-        ASSERT(fwrite(&sliding_pieces[1].blocker_mask[square], sizeof(UInt64), 1, output_file) == 1);
-        ASSERT(fwrite(&sliding_pieces[1].blocker_bit_count[square], sizeof(UInt64), 1, output_file) == 1);
-        ASSERT(fwrite(&sliding_pieces[1].magic[square], sizeof(UInt64), 1, output_file) == 1);
-        Int blocker_count = 1 << sliding_pieces[1].blocker_bit_count[square];
+        MagicSearch *search = &magic_searcher.searches[search_i];
+        SlidingPiece *sliding_piece = &sliding_pieces[search->piece_type];
+        Int blocker_count = 1 << search->blocker_bit_count;
         for (Int blocker_i = 0; blocker_i < blocker_count; blocker_i++)
         {
-            ASSERT(fwrite(&sliding_pieces[1].move[square][blocker_i], sizeof(UInt64), 1, output_file) == 1);
+            pext_move[sliding_piece->pext_offset[search->square] + blocker_i] = search->move[blocker_i];
         }
     }
 
-    for (Int square = 0; square < 64; square++)
-    {
-        ASSERT(fwrite(&king[square], sizeof(UInt64), 1, output_file) == 1);
-    }
+    file->header.checksum = get_checksum(data + sizeof(BitBoardTableFileHeader), size - sizeof(BitBoardTableFileHeader));
+
+    FILE *output_file = fopen(output_filename, "wb");
+    ASSERT(output_file);
+    ASSERT(fwrite(data, 1, size, output_file) == size);
+    ASSERT(fclose(output_file) == 0);
 }
+
+#include "../lib/util.cpp"
+#include "../lib/os.cpp"
@@ -1,4 +1,7 @@
 #include "os.hpp"
+
+#if defined(_WIN32)
+
 #include <windows.h>
 
 Handle load_library(Str library_name)
@@ -73,6 +76,52 @@ Void sleep(Int milisecond)
     Sleep(milisecond);
 }
 
+Int get_processor_count()
+{
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    return system_info.dwNumberOfProcessors;
+}
+
+Bool map_file(CStr filename, Str *contents)
+{
+    HANDLE file_handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, null, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, null);
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_handle, &size) || size.QuadPart <= 0 || size.QuadPart > 0x7fffffff)
+    {
+        CloseHandle(file_handle);
+        return false;
+    }
+
+    HANDLE mapping_handle = CreateFileMappingA(file_handle, null, PAGE_READONLY, 0, 0, null);
+    CloseHandle(file_handle);
+    if (!mapping_handle)
+    {
+        return false;
+    }
+
+    Void *data = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping_handle);
+    if (!data)
+    {
+        return false;
+    }
+
+    contents->data = (UInt8 *)data;
+    contents->count = (Int)size.QuadPart;
+    return true;
+}
+
+Void unmap_file(Str contents)
+{
+    UnmapViewOfFile(contents.data);
+}
+
 Void *run_thread(Void func(Void *data), Void *data)
 {
     return CreateThread(null, 0, (LPTHREAD_START_ROUTINE)func, data, 0, null);
@@ -93,3 +142,156 @@ Bool up_semaphore(Void *semaphore, Int count)
 {
     return ReleaseSemaphore(semaphore, count, null);
 }
+
+#else
+
+// NOTE: POSIX implementation for headless tools, there is no window support
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+Handle load_library(Str library_name)
+{
+    return dlopen((CStr)library_name.data, RTLD_NOW);
+}
+
+Void *load_library_func(Handle library, Str func_name)
+{
+    return dlsym(library, (CStr)func_name.data);
+}
+
+Handle create_window(Str title, Int client_width, Int client_height, Int window_x, Int window_y)
+{
+    return null;
+}
+
+UInt64 get_current_timestamp()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    UInt64 result = (UInt64)time.tv_sec * 1000000000ull + (UInt64)time.tv_nsec;
+    return result;
+}
+
+Real64 get_elapsed_time(UInt64 timestamp)
+{
+    Real64 result = timestamp / 1000000000.0;
+    return result;
+}
+
+Void sleep(Int milisecond)
+{
+    timespec time;
+    time.tv_sec = milisecond / 1000;
+    time.tv_nsec = (milisecond % 1000) * 1000000l;
+    nanosleep(&time, null);
+}
+
+Int get_processor_count()
+{
+    Int result = (Int)sysconf(_SC_NPROCESSORS_ONLN);
+    return MAX(result, 1);
+}
+
+Bool map_file(CStr filename, Str *contents)
+{
+    Int file = open(filename, O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(file, &file_stat) != 0 || file_stat.st_size <= 0 || file_stat.st_size > 0x7fffffff)
+    {
+        close(file);
+        return false;
+    }
+
+    Void *data = mmap(null, file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    contents->data = (UInt8 *)data;
+    contents->count = (Int)file_stat.st_size;
+    return true;
+}
+
+Void unmap_file(Str contents)
+{
+    munmap(contents.data, contents.count);
+}
+
+struct ThreadStart
+{
+    ThreadFunc func;
+    Void *data;
+};
+
+// NOTE: pthread_create wants a function returning a pointer, calling func through a cast pointer would be undefined
+Void *run_thread_start(Void *data)
+{
+    ThreadStart thread_start = *(ThreadStart *)data;
+    free(data);
+    thread_start.func(thread_start.data);
+    return null;
+}
+
+Void *run_thread(Void func(Void *data), Void *data)
+{
+    ThreadStart *thread_start = (ThreadStart *)malloc(sizeof(ThreadStart));
+    if (!thread_start)
+    {
+        return null;
+    }
+    thread_start->func = func;
+    thread_start->data = data;
+
+    pthread_t thread;
+    if (pthread_create(&thread, null, run_thread_start, thread_start) != 0)
+    {
+        free(thread_start);
+        return null;
+    }
+    pthread_detach(thread);
+    return (Void *)thread;
+}
+
+Void *create_semaphore(Int count)
+{
+    sem_t *semaphore = (sem_t *)malloc(sizeof(sem_t));
+    if (!semaphore || sem_init(semaphore, 0, count) != 0)
+    {
+        free(semaphore);
+        return null;
+    }
+    return semaphore;
+}
+
+Bool down_semaphore(Void *semaphore)
+{
+    Int result = sem_wait((sem_t *)semaphore);
+    return result == 0;
+}
+
+Bool up_semaphore(Void *semaphore, Int count)
+{
+    for (Int i = 0; i < count; i++)
+    {
+        if (sem_post((sem_t *)semaphore) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
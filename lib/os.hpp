@@ -12,6 +12,12 @@ Real64 get_elapsed_time(UInt64 timestamp);
 
 Void sleep(Int milisecond);
 
+Int get_processor_count();
+
+// NOTE: Maps the whole file read only, the mapping stays until unmap_file or the process exits
+Bool map_file(CStr filename, Str *contents);
+Void unmap_file(Str contents);
+
 typedef Void (*ThreadFunc)(Void *data);
 Void *run_thread(Void func(Void *), Void *data);
 Void *create_semaphore(Int count);
@@ -2,6 +2,14 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#if defined(__POPCNT__) || defined(__BMI__) || defined(__LZCNT__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
 
 UInt align_up(UInt x, UInt mask)
 {
@@ -9,25 +17,157 @@ UInt align_up(UInt x, UInt mask)
     return result;
 }
 
+// NOTE: Bit operations use POPCNT / BMI1 / LZCNT instructions when the compiler targets them (-mpopcnt -mbmi -mlzcnt),
+// otherwise fall back to branch free portable versions.
 Int bit_count(UInt64 x)
 {
-    Int result = 0;
-    while (x)
+#if defined(__POPCNT__)
+    Int result = (Int)_mm_popcnt_u64(x);
+    return result;
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    Int result = (Int)((x * 0x0101010101010101ull) >> 56);
+    return result;
+#endif
+}
+
+#if !defined(__BMI__) || !defined(__LZCNT__)
+#define DE_BRUIJN_MAGIC (0x03f79d71b4cb0a89ull)
+
+Int de_bruijn_index[64] = {
+    0, 47, 1, 56, 48, 27, 2, 60,
+    57, 49, 41, 37, 28, 16, 3, 61,
+    54, 58, 35, 52, 50, 42, 21, 44,
+    38, 32, 29, 23, 17, 11, 4, 62,
+    46, 55, 26, 59, 40, 36, 15, 53,
+    34, 51, 20, 43, 31, 22, 10, 45,
+    25, 39, 14, 33, 19, 30, 9, 24,
+    13, 18, 8, 12, 7, 6, 5, 63,
+};
+#endif
+
+// NOTE: Index of the lowest set bit, -1 if there is none
+Int first_set(UInt64 x)
+{
+    if (!x)
     {
-        x &= x - 1;
-        result++;
+        return -1;
     }
+#if defined(__BMI__)
+    Int result = (Int)_tzcnt_u64(x);
     return result;
+#else
+    Int result = de_bruijn_index[((x ^ (x - 1)) * DE_BRUIJN_MAGIC) >> 58];
+    return result;
+#endif
 }
 
-Int first_set(UInt64 x)
+// NOTE: Index of the highest set bit, -1 if there is none
+Int last_set(UInt64 x)
 {
-    Int result = -1;
-    while (x)
+    if (!x)
     {
-        result++;
-        x >>= 1;
+        return -1;
     }
+#if defined(__LZCNT__)
+    Int result = 63 - (Int)_lzcnt_u64(x);
+    return result;
+#else
+    x |= x >> 1;
+    x |= x >> 2;
+    x |= x >> 4;
+    x |= x >> 8;
+    x |= x >> 16;
+    x |= x >> 32;
+    Int result = de_bruijn_index[(x * DE_BRUIJN_MAGIC) >> 58];
+    return result;
+#endif
+}
+
+Void get_cpuid(UInt32 leaf, UInt32 sub_leaf, UInt32 *registers)
+{
+#if defined(_MSC_VER)
+    __cpuidex((int *)registers, leaf, sub_leaf);
+#else
+    __cpuid_count(leaf, sub_leaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+#if defined(__AVX2__)
+// NOTE: Register state the OS saves on a context switch, AVX needs the SSE and AVX bits
+UInt64 get_xcr0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    UInt32 eax;
+    UInt32 edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((UInt64)edx << 32) | eax;
+#endif
+}
+#endif
+
+// NOTE: A build targeting POPCNT / BMI1 / LZCNT / BMI2 / SSE4.1 / AVX2 dies with an illegal instruction on a CPU without
+// them, so check the CPU against what the compiler targets before running anything
+Bool check_cpu_features()
+{
+    UInt32 registers[4];
+    get_cpuid(0, 0, registers);
+    UInt32 max_leaf = registers[0];
+    get_cpuid(0x80000000, 0, registers);
+    UInt32 max_extended_leaf = registers[0];
+
+    UInt32 leaf1_ecx = 0;
+    UInt32 leaf7_ebx = 0;
+    UInt32 extended_leaf1_ecx = 0;
+    if (max_leaf >= 1)
+    {
+        get_cpuid(1, 0, registers);
+        leaf1_ecx = registers[2];
+    }
+    if (max_leaf >= 7)
+    {
+        get_cpuid(7, 0, registers);
+        leaf7_ebx = registers[1];
+    }
+    if (max_extended_leaf >= 0x80000001)
+    {
+        get_cpuid(0x80000001, 0, registers);
+        extended_leaf1_ecx = registers[2];
+    }
+
+    UInt32 leaf1_ecx_required = 0;
+    UInt32 leaf7_ebx_required = 0;
+    UInt32 extended_leaf1_ecx_required = 0;
+#if defined(__POPCNT__)
+    leaf1_ecx_required |= 1 << 23;
+#endif
+#if defined(__BMI__)
+    leaf7_ebx_required |= 1 << 3;
+#endif
+#if defined(__BMI2__)
+    leaf7_ebx_required |= 1 << 8;
+#endif
+#if defined(__LZCNT__)
+    extended_leaf1_ecx_required |= 1 << 5;
+#endif
+#if defined(__SSE4_1__)
+    leaf1_ecx_required |= 1 << 19;
+#endif
+#if defined(__AVX2__)
+    // NOTE: OSXSAVE as well, the OS has to save the upper halves of the registers
+    leaf1_ecx_required |= 1 << 27;
+    leaf7_ebx_required |= 1 << 5;
+#endif
+    Bool result = (leaf1_ecx & leaf1_ecx_required) == leaf1_ecx_required &&
+                  (leaf7_ebx & leaf7_ebx_required) == leaf7_ebx_required &&
+                  (extended_leaf1_ecx & extended_leaf1_ecx_required) == extended_leaf1_ecx_required;
+#if defined(__AVX2__)
+    result = result && (get_xcr0() & 6) == 6;
+#endif
     return result;
 }
 
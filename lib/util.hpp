@@ -56,6 +56,8 @@ Void swap(T *x, T *y)
 UInt align_up(UInt x, UInt mask);
 Int bit_count(UInt64 x);
 Int first_set(UInt64 x);
+Int last_set(UInt64 x);
+Bool check_cpu_features();
 
 template <typename T>
 struct Buffer
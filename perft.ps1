@@ -0,0 +1,7 @@
+clang-cl /W4 /Zi -O2 /EHa -mpopcnt -mbmi -mlzcnt -o bin/perft.exe `
+    -Wno-logical-op-parentheses -Wno-switch -Wno-unused-label -Wno-unused-parameter -Wno-missing-field-initializers -Wno-missing-braces -Wno-writable-strings -Wno-deprecated-declarations `
+    perft/main.cpp `
+    /link /NATVIS:misc/debug.natvis user32.lib
+
+bin/perft.exe suite
+if ($LASTEXITCODE -eq 0) { bin/perft.exe see }
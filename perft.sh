@@ -0,0 +1,13 @@
+#!/bin/sh
+set -e
+mkdir -p bin
+FLAGS="-std=c++14 -O2 -g -Wall -Wno-switch -Wno-unused-label -Wno-unused-parameter -Wno-missing-field-initializers -Wno-missing-braces -Wno-write-strings -Wno-deprecated-declarations"
+
+# NOTE: perft_portable is built without the bit instruction flags to compare against the intrinsics path, perft_pext
+# adds BMI2 for the PEXT sliding attack backend, perft_nnue the network evaluation with AVX2 kernels for perft nnue
+${CXX:-clang++} $FLAGS -mpopcnt -mbmi -mlzcnt perft/main.cpp -o bin/perft -lpthread -ldl
+${CXX:-clang++} $FLAGS perft/main.cpp -o bin/perft_portable -lpthread -ldl
+${CXX:-clang++} $FLAGS -mpopcnt -mbmi -mlzcnt -mbmi2 perft/main.cpp -o bin/perft_pext -lpthread -ldl
+${CXX:-clang++} $FLAGS -mpopcnt -mbmi -mlzcnt -mavx2 -DNNUE_EVAL perft/main.cpp -o bin/perft_nnue -lpthread -ldl
+
+bin/perft suite && bin/perft see
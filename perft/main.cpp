@@ -0,0 +1,972 @@
+#include "../lib/util.hpp"
+#include "../lib/os.hpp"
+#include "../src/game.cpp"
+#include "../src/search.cpp"
+
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+struct PerftCase
+{
+    CStr name;
+    CStr fen;
+    Int depth_count;
+    UInt64 node_counts[6];
+};
+
+// NOTE: Reference node counts from https://www.chessprogramming.org/Perft_Results
+PerftCase perft_cases[] = {
+    {"start", START_FEN, 5, {20, 400, 8902, 197281, 4865609}},
+    {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4, {48, 2039, 97862, 4085603}},
+    {"position3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6, {14, 191, 2812, 43238, 674624, 11030083}},
+    {"position4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 5, {6, 264, 9467, 422333, 15833292}},
+    {"position5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4, {44, 1486, 62379, 2103487}},
+    {"position6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4, {46, 2079, 89890, 3894594}},
+};
+
+UInt64 perft(GameState *state, Int depth)
+{
+    GameMove moves_data[256];
+    Buffer<GameMove> moves;
+    moves.count = 0;
+    moves.data = moves_data;
+    generate_all_moves(state, &moves);
+    if (depth <= 1)
+    {
+        return moves.count;
+    }
+
+    UInt64 node_count = 0;
+    for (Int i = 0; i < moves.count; i++)
+    {
+        GameMove move = moves[i];
+        record_game_move(state, move);
+        node_count += perft(state, depth - 1);
+        rollback_game_move(state, move);
+    }
+    return node_count;
+}
+
+UInt64 perft_copy_make(SearchPosition *position, Int depth)
+{
+    GameMove moves_data[256];
+    Buffer<GameMove> moves;
+    moves.count = 0;
+    moves.data = moves_data;
+    generate_all_moves(position, &moves);
+    if (depth <= 1)
+    {
+        return moves.count;
+    }
+
+    UInt64 node_count = 0;
+    for (Int i = 0; i < moves.count; i++)
+    {
+        SearchPosition next_position;
+        apply_move(position, moves[i], &next_position);
+        node_count += perft_copy_make(&next_position, depth - 1);
+    }
+    return node_count;
+}
+
+Void print_move(GameMove move)
+{
+    Square square_from = get_from(move);
+    Square square_to = get_to(move);
+    printf("%c%c%c%c", 'a' + get_column(square_from), '1' + get_row(square_from), 'a' + get_column(square_to), '1' + get_row(square_to));
+    if (get_move_type(move) == GameMoveType::promotion)
+    {
+        CStr promotion_chars = "qrbn";
+        printf("%c", promotion_chars[get_promotion_index(move)]);
+    }
+}
+
+UInt64 divide(GameState *state, Int depth)
+{
+    GameMove moves_data[256];
+    Buffer<GameMove> moves;
+    moves.count = 0;
+    moves.data = moves_data;
+    generate_all_moves(state, &moves);
+
+    UInt64 node_count = 0;
+    for (Int i = 0; i < moves.count; i++)
+    {
+        GameMove move = moves[i];
+        UInt64 move_node_count = 1;
+        if (depth > 1)
+        {
+            record_game_move(state, move);
+            move_node_count = perft(state, depth - 1);
+            rollback_game_move(state, move);
+        }
+        node_count += move_node_count;
+        print_move(move);
+        printf(": %llu\n", (unsigned long long)move_node_count);
+    }
+    return node_count;
+}
+
+Void print_result(UInt64 node_count, UInt64 start_timestamp)
+{
+    Real64 time = get_elapsed_time(get_current_timestamp() - start_timestamp);
+    Real64 node_per_second = time > 0 ? node_count / time : 0;
+    printf("nodes %llu  time %.3fs  nps %.0f\n", (unsigned long long)node_count, time, node_per_second);
+}
+
+Bool run_suite(Int max_depth)
+{
+    Bool success = true;
+    UInt64 total_node_count = 0;
+    UInt64 suite_timestamp = get_current_timestamp();
+    for (Int case_i = 0; case_i < (Int)(sizeof(perft_cases) / sizeof(perft_cases[0])); case_i++)
+    {
+        PerftCase *perft_case = &perft_cases[case_i];
+        GameState state;
+        ASSERT(get_game_state_from_fen(GameSide::white, str(perft_case->fen), &state));
+
+        Int depth_count = MIN(perft_case->depth_count, max_depth);
+        for (Int depth = 1; depth <= depth_count; depth++)
+        {
+            UInt64 expected_node_count = perft_case->node_counts[depth - 1];
+            UInt64 timestamp = get_current_timestamp();
+            UInt64 node_count = perft(&state, depth);
+            Bool pass = node_count == expected_node_count;
+            success = success && pass;
+            total_node_count += node_count;
+
+            printf("%-10s depth %d  %s  expected %llu  ", perft_case->name, depth, pass ? "ok  " : "FAIL", (unsigned long long)expected_node_count);
+            print_result(node_count, timestamp);
+        }
+    }
+    printf("%s  ", success ? "all passed" : "FAILED");
+    print_result(total_node_count, suite_timestamp);
+    return success;
+}
+
+Bool find_move(GameState *state, CStr move_str, GameMove *result)
+{
+    GameMove moves_data[256];
+    Buffer<GameMove> moves;
+    moves.count = 0;
+    moves.data = moves_data;
+    generate_all_moves(state, &moves);
+    for (Int i = 0; i < moves.count; i++)
+    {
+        GameMove move = moves[i];
+        Square square_from = get_from(move);
+        Square square_to = get_to(move);
+        char promotion_char = get_move_type(move) == GameMoveType::promotion ? "qrbn"[get_promotion_index(move)] : 0;
+        if (move_str[0] == 'a' + get_column(square_from) && move_str[1] == '1' + get_row(square_from) &&
+            move_str[2] == 'a' + get_column(square_to) && move_str[3] == '1' + get_row(square_to) && move_str[4] == promotion_char)
+        {
+            *result = move;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct SeeCase
+{
+    CStr fen;
+    CStr move;
+    Int value;
+};
+
+// NOTE: Values with see_values of 100, 325, 325, 500, 975
+SeeCase see_cases[] = {
+    {"1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1", "e1e5", 100},
+    {"1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1", "d3e5", -225},
+    {"4k3/8/2p5/3n4/4P3/8/8/4K3 w - - 0 1", "e4d5", 225},
+    {"4k3/8/2p5/3p4/8/8/3Q4/4K3 w - - 0 1", "d2d5", -875},
+    {"4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 1", "e5d6", 100},
+    {"4k3/P7/8/8/8/8/8/4K3 w - - 0 1", "a7a8q", 875},
+    {"4k3/P7/8/8/8/8/8/4K3 w - - 0 1", "a7a8n", 225},
+    {"1rk5/P7/8/8/8/8/8/4K3 w - - 0 1", "a7b8q", 400},
+    {"3rk3/8/8/3r4/8/8/3R4/3RK3 w - - 0 1", "d2d5", 500},
+    {"4k3/8/8/4p3/3q4/8/1B6/B3K3 w - - 0 1", "b2d4", 750},
+    {"4k3/8/8/2p5/8/8/8/3RK3 w - - 0 1", "d1d4", -500},
+    {"4k3/8/8/3p4/4N3/8/8/4K3 b - - 0 1", "d5e4", 325},
+};
+
+Bool run_see_cases()
+{
+    Bool success = true;
+    for (Int case_i = 0; case_i < (Int)(sizeof(see_cases) / sizeof(see_cases[0])); case_i++)
+    {
+        SeeCase *see_case = &see_cases[case_i];
+        GameState state;
+        GameMove move;
+        if (!get_game_state_from_fen(GameSide::white, str(see_case->fen), &state) || !find_move(&state, see_case->move, &move))
+        {
+            printf("%-6s invalid case  %s\n", see_case->move, see_case->fen);
+            success = false;
+            continue;
+        }
+
+        Int value = get_see(&state, move);
+        Bool ok = value == see_case->value;
+        success = success && ok;
+        printf("%-6s %-5s expected %5d  value %5d  %s\n", see_case->move, ok ? "ok" : "FAIL", see_case->value, value, see_case->fen);
+    }
+    printf(success ? "all passed\n" : "failed\n");
+    return success;
+}
+
+// NOTE: Bit operations as they were before the intrinsics path, kept as the benchmark baseline
+Int bit_count_loop(UInt64 x)
+{
+    Int result = 0;
+    while (x)
+    {
+        x &= x - 1;
+        result++;
+    }
+    return result;
+}
+
+Int last_set_loop(UInt64 x)
+{
+    Int result = -1;
+    while (x)
+    {
+        result++;
+        x >>= 1;
+    }
+    return result;
+}
+
+struct BenchPosition
+{
+    BitBoard occupancy_side[GameSide::count];
+    BitBoard occupancy_piece_type[GamePieceType::count];
+    GameSideEnum current_side;
+    UInt64 pawn_zobrist;
+    Int material_pawn[GameSide::count];
+    Int material_non_pawn[GameSide::count];
+    ValuePair square_value[GameSide::count];
+    Int phase;
+};
+
+Void load_bench_position(GameState *state, BenchPosition *position)
+{
+    memcpy(state->occupancy_side, position->occupancy_side, sizeof(state->occupancy_side));
+    memcpy(state->occupancy_piece_type, position->occupancy_piece_type, sizeof(state->occupancy_piece_type));
+    state->current_side = position->current_side;
+    state->pawn_zobrist = position->pawn_zobrist;
+    memcpy(state->material_pawn, position->material_pawn, sizeof(state->material_pawn));
+    memcpy(state->material_non_pawn, position->material_non_pawn, sizeof(state->material_non_pawn));
+    memcpy(state->square_value, position->square_value, sizeof(state->square_value));
+    state->phase = position->phase;
+}
+
+// NOTE: Capture generation must match the captures and promotions among all legal moves
+Bool check_capture_moves(GameState *state)
+{
+    GameMove moves_data[256];
+    Buffer<GameMove> moves;
+    moves.count = 0;
+    moves.data = moves_data;
+    generate_all_moves(state, &moves);
+
+    GameMove capture_moves_data[256];
+    Buffer<GameMove> capture_moves;
+    capture_moves.count = 0;
+    capture_moves.data = capture_moves_data;
+    generate_capture_moves(state, &capture_moves);
+
+    Int capture_count = 0;
+    for (Int i = 0; i < moves.count; i++)
+    {
+        if (is_quiet_move(moves[i]))
+        {
+            continue;
+        }
+        capture_count++;
+
+        Bool found = false;
+        for (Int j = 0; j < capture_moves.count; j++)
+        {
+            found = found || capture_moves[j] == moves[i];
+        }
+        if (!found)
+        {
+            return false;
+        }
+    }
+    Bool result = capture_count == capture_moves.count;
+    return result;
+}
+
+Void collect_bench_positions(GameState *state, Int depth, Array<BenchPosition> *positions)
+{
+    // NOTE: Every collected position also checks the incremental evaluation and the capture generation
+    ASSERT(check_eval_accumulators(state));
+    ASSERT(check_capture_moves(state));
+    BenchPosition *position = positions->push();
+    memcpy(position->occupancy_side, state->occupancy_side, sizeof(state->occupancy_side));
+    memcpy(position->occupancy_piece_type, state->occupancy_piece_type, sizeof(state->occupancy_piece_type));
+    position->current_side = state->current_side;
+    position->pawn_zobrist = state->pawn_zobrist;
+    memcpy(position->material_pawn, state->material_pawn, sizeof(state->material_pawn));
+    memcpy(position->material_non_pawn, state->material_non_pawn, sizeof(state->material_non_pawn));
+    memcpy(position->square_value, state->square_value, sizeof(state->square_value));
+    position->phase = state->phase;
+    if (depth == 0)
+    {
+        return;
+    }
+
+    GameMove moves_data[256];
+    Buffer<GameMove> moves;
+    moves.count = 0;
+    moves.data = moves_data;
+    generate_all_moves(state, &moves);
+    for (Int i = 0; i < moves.count; i++)
+    {
+        record_game_move(state, moves[i]);
+        collect_bench_positions(state, depth - 1, positions);
+        rollback_game_move(state, moves[i]);
+    }
+}
+
+struct SeeMove
+{
+    Int state_index;
+    GameMove move;
+};
+
+Void collect_see_moves(GameState *state, Int depth, Array<GameState> *states, Array<SeeMove> *see_moves)
+{
+    GameMove moves_data[256];
+    Buffer<GameMove> moves;
+    moves.count = 0;
+    moves.data = moves_data;
+    generate_all_moves(state, &moves);
+
+    Int state_index = states->count;
+    *states->push() = *state;
+    for (Int i = 0; i < moves.count; i++)
+    {
+        if (!is_quiet_move(moves[i]))
+        {
+            SeeMove *see_move = see_moves->push();
+            see_move->state_index = state_index;
+            see_move->move = moves[i];
+        }
+    }
+
+    if (depth == 0)
+    {
+        return;
+    }
+    for (Int i = 0; i < moves.count; i++)
+    {
+        record_game_move(state, moves[i]);
+        collect_see_moves(state, depth - 1, states, see_moves);
+        rollback_game_move(state, moves[i]);
+    }
+}
+
+namespace EvalTerm
+{
+enum
+{
+    material,
+    square,
+    material_adjust,
+    pawn_structure,
+    mobility,
+    theme,
+    blockage,
+    attack,
+    safety,
+    all,
+    all_pawn_table,
+
+    count,
+};
+}
+typedef Int EvalTermEnum;
+
+CStr eval_term_names[EvalTerm::count] = {"material", "square", "material_adjust", "pawn_structure", "mobility", "theme", "blockage", "attack", "safety", "eval", "eval (pawn table)"};
+
+PawnTable bench_pawn_table;
+
+template <GameSideEnum Side>
+Int run_eval_term(GameState *state, EvalTermEnum term)
+{
+    switch (term)
+    {
+    case EvalTerm::material:
+    {
+        return eval_material(state, Side).all;
+    }
+    case EvalTerm::square:
+    {
+        ValuePair value = eval_square(state, Side);
+        return value.middle + value.end;
+    }
+    case EvalTerm::material_adjust:
+    {
+        return eval_material_adjust<Side>(state);
+    }
+    case EvalTerm::pawn_structure:
+    {
+        BitBoard passed_occupancy;
+        return eval_pawn_structure<Side>(state, &passed_occupancy);
+    }
+    case EvalTerm::mobility:
+    {
+        ValuePair value = eval_mobility<Side>(state);
+        return value.middle + value.end;
+    }
+    case EvalTerm::theme:
+    {
+        ValuePair value = eval_theme<Side>(state);
+        return value.middle + value.end;
+    }
+    case EvalTerm::blockage:
+    {
+        return eval_blockage<Side>(state);
+    }
+    case EvalTerm::attack:
+    {
+        return eval_attack<Side>(state);
+    }
+    case EvalTerm::safety:
+    {
+        ValuePair value = eval_safety<Side>(state);
+        return value.middle + value.end;
+    }
+    case EvalTerm::all:
+    {
+        return Side == GameSide::white ? eval(state, state->current_side, NULL) : 0;
+    }
+    case EvalTerm::all_pawn_table:
+    {
+        return Side == GameSide::white ? eval(state, state->current_side, &bench_pawn_table) : 0;
+    }
+    default:
+    {
+        ASSERT(false);
+        return 0;
+    }
+    }
+}
+
+Void run_search_move(Searcher *searcher)
+{
+    searcher->search_state = SearchState::working;
+    ASSERT(up_semaphore(searcher->semaphore, 1));
+    while (searcher->search_state != SearchState::finished)
+    {
+        sleep(1);
+    }
+    searcher->search_state = SearchState::idle;
+}
+
+#define BENCH_SEARCH_DEPTH (9)
+
+Void run_bench()
+{
+#if defined(__POPCNT__)
+    printf("bit_count: popcnt  ");
+#else
+    printf("bit_count: portable  ");
+#endif
+#if defined(__BMI__)
+    printf("first_set: tzcnt  ");
+#else
+    printf("first_set: portable  ");
+#endif
+#if defined(__LZCNT__)
+    printf("last_set: lzcnt  ");
+#else
+    printf("last_set: portable  ");
+#endif
+#if defined(__BMI2__)
+    printf("sliding attack: pext\n");
+#else
+    printf("sliding attack: magic\n");
+#endif
+
+    // NOTE: Raw bit operations on bit boards with a realistic spread of bit counts
+    Int bit_board_count = 1 << 20;
+    BitBoard *bit_boards = (BitBoard *)malloc(bit_board_count * sizeof(BitBoard));
+    RandomGenerator random_generator;
+    random_generator.seed = 0xb17b0a4d;
+    for (Int i = 0; i < bit_board_count; i++)
+    {
+        bit_boards[i] = get_random_number(&random_generator);
+        for (Int j = 0; j < i % 4; j++)
+        {
+            bit_boards[i] &= get_random_number(&random_generator);
+        }
+    }
+
+    Int (*bit_functions[])(UInt64) = {bit_count_loop, bit_count, last_set_loop, last_set, first_set};
+    CStr bit_function_names[] = {"bit_count (loop)", "bit_count", "last_set (loop)", "last_set", "first_set"};
+    for (Int function_i = 0; function_i < (Int)(sizeof(bit_functions) / sizeof(bit_functions[0])); function_i++)
+    {
+        Int (*bit_function)(UInt64) = bit_functions[function_i];
+        Int repeat_count = 16;
+        UInt64 sum = 0;
+        UInt64 timestamp = get_current_timestamp();
+        for (Int repeat = 0; repeat < repeat_count; repeat++)
+        {
+            for (Int i = 0; i < bit_board_count; i++)
+            {
+                sum += bit_function(bit_boards[i] ^ repeat);
+            }
+        }
+        Real64 time = get_elapsed_time(get_current_timestamp() - timestamp);
+        printf("%-18s %6.2f ns/op  (checksum %llu)\n", bit_function_names[function_i], time * 1e9 / ((Real64)bit_board_count * repeat_count), (unsigned long long)sum);
+    }
+
+    // NOTE: Rook plus bishop attack lookups with the same bit boards as occupancy
+    BitBoard (*sliding_functions[])(const SlidingPieceTable *, Square, BitBoard) = {
+        get_magic_sliding_piece_attack,
+#if defined(__BMI2__)
+        get_pext_sliding_piece_attack,
+#endif
+    };
+    CStr sliding_function_names[] = {"sliding (magic)", "sliding (pext)"};
+    for (Int function_i = 0; function_i < (Int)(sizeof(sliding_functions) / sizeof(sliding_functions[0])); function_i++)
+    {
+        BitBoard (*sliding_function)(const SlidingPieceTable *, Square, BitBoard) = sliding_functions[function_i];
+        Int repeat_count = 8;
+        UInt64 sum = 0;
+        UInt64 timestamp = get_current_timestamp();
+        for (Int repeat = 0; repeat < repeat_count; repeat++)
+        {
+            for (Int i = 0; i < bit_board_count; i++)
+            {
+                Square square = (i + repeat) & 63;
+                sum += sliding_function(&bit_board_table.rook_table, square, bit_boards[i]);
+                sum += sliding_function(&bit_board_table.bishop_table, square, bit_boards[i]);
+            }
+        }
+        Real64 time = get_elapsed_time(get_current_timestamp() - timestamp);
+        printf("%-18s %6.2f ns/op  (checksum %llu)\n", sliding_function_names[function_i], time * 1e9 / ((Real64)bit_board_count * repeat_count * 2), (unsigned long long)sum);
+    }
+    free(bit_boards);
+
+    // NOTE: Evaluation terms over positions reached from the perft suite
+    Array<BenchPosition> positions = create_array<BenchPosition>(1 << 16);
+    for (Int case_i = 0; case_i < (Int)(sizeof(perft_cases) / sizeof(perft_cases[0])); case_i++)
+    {
+        GameState state;
+        ASSERT(get_game_state_from_fen(GameSide::white, str(perft_cases[case_i].fen), &state));
+        collect_bench_positions(&state, 2, &positions);
+    }
+
+    GameState bench_state;
+    ASSERT(get_game_state_from_fen(GameSide::white, str(START_FEN), &bench_state));
+    ASSERT(initialize_pawn_table(&bench_pawn_table));
+    for (EvalTermEnum term = 0; term < EvalTerm::count; term++)
+    {
+        Int repeat_count = 8;
+        Int64 sum = 0;
+        UInt64 timestamp = get_current_timestamp();
+        for (Int repeat = 0; repeat < repeat_count; repeat++)
+        {
+            for (Int i = 0; i < positions.count; i++)
+            {
+                load_bench_position(&bench_state, &positions[i]);
+                sum += run_eval_term<GameSide::white>(&bench_state, term);
+                sum += run_eval_term<GameSide::black>(&bench_state, term);
+            }
+        }
+        Real64 time = get_elapsed_time(get_current_timestamp() - timestamp);
+        printf("%-18s %8.1f ns/position  (checksum %lld)\n", eval_term_names[term], time * 1e9 / ((Real64)positions.count * repeat_count), (long long)sum);
+    }
+    UInt64 pawn_probe_count = bench_pawn_table.hit_count + bench_pawn_table.miss_count;
+    printf("pawn table hit rate %.1f%%\n", pawn_probe_count ? 100.0 * bench_pawn_table.hit_count / pawn_probe_count : 0.0);
+    free(bench_pawn_table.entries);
+    destroy_array(positions);
+
+    // NOTE: Static exchange evaluation of every capture in the suite positions and the positions one move after
+    Array<GameState> see_states = create_array<GameState>(256);
+    Array<SeeMove> see_moves = create_array<SeeMove>(4096);
+    for (Int case_i = 0; case_i < (Int)(sizeof(perft_cases) / sizeof(perft_cases[0])); case_i++)
+    {
+        GameState state;
+        ASSERT(get_game_state_from_fen(GameSide::white, str(perft_cases[case_i].fen), &state));
+        collect_see_moves(&state, 1, &see_states, &see_moves);
+    }
+
+    Int repeat_count = 256;
+    Int64 see_sum = 0;
+    UInt64 timestamp = get_current_timestamp();
+    for (Int repeat = 0; repeat < repeat_count; repeat++)
+    {
+        for (Int i = 0; i < see_moves.count; i++)
+        {
+            see_sum += get_see(&see_states[see_moves[i].state_index], see_moves[i].move);
+        }
+    }
+    Real64 time = get_elapsed_time(get_current_timestamp() - timestamp);
+    Real64 see_count = (Real64)see_moves.count * repeat_count;
+    printf("%-18s %8.1f ns/call  %.1f M calls/s  (checksum %lld)\n", "see", time * 1e9 / see_count, see_count / time / 1e6, (long long)see_sum);
+    destroy_array(see_states);
+    destroy_array(see_moves);
+
+    // NOTE: Make/unmake on the full game state against copy-make on the hot search position
+    printf("sizeof(GameState) %d  sizeof(SearchPosition) %d\n", (Int)sizeof(GameState), (Int)sizeof(SearchPosition));
+    UInt64 make_node_count = 0;
+    UInt64 copy_node_count = 0;
+    Real64 make_time = 0;
+    Real64 copy_time = 0;
+    for (Int case_i = 0; case_i < (Int)(sizeof(perft_cases) / sizeof(perft_cases[0])); case_i++)
+    {
+        GameState state;
+        ASSERT(get_game_state_from_fen(GameSide::white, str(perft_cases[case_i].fen), &state));
+        Int depth = MIN(perft_cases[case_i].depth_count, 4);
+
+        UInt64 make_timestamp = get_current_timestamp();
+        make_node_count += perft(&state, depth);
+        make_time += get_elapsed_time(get_current_timestamp() - make_timestamp);
+
+        SearchPosition position = state;
+        UInt64 copy_timestamp = get_current_timestamp();
+        copy_node_count += perft_copy_make(&position, depth);
+        copy_time += get_elapsed_time(get_current_timestamp() - copy_timestamp);
+    }
+    ASSERT(make_node_count == copy_node_count);
+    printf("%-18s %8.1f M nodes/s\n", "perft (make)", make_node_count / make_time / 1e6);
+    printf("%-18s %8.1f M nodes/s\n", "perft (copy)", copy_node_count / copy_time / 1e6);
+
+    // NOTE: Fixed depth searches of the suite positions with and without the eval cache, which must not change the tree
+    GameState search_state;
+    UInt64 search_node_counts[2] = {};
+    for (Int eval_cache_enabled = 0; eval_cache_enabled <= 1; eval_cache_enabled++)
+    {
+        Searcher searcher;
+        ASSERT(initialize_searcher(&searcher, &search_state, 1));
+        searcher.limit = get_depth_search_limit(BENCH_SEARCH_DEPTH);
+        searcher.eval_cache_enabled = eval_cache_enabled;
+        ASSERT(run_thread((ThreadFunc)search, &searcher));
+
+        Real64 search_time = 0;
+        UInt64 hit_count = 0;
+        UInt64 miss_count = 0;
+        for (Int case_i = 0; case_i < (Int)(sizeof(perft_cases) / sizeof(perft_cases[0])); case_i++)
+        {
+            ASSERT(get_game_state_from_fen(GameSide::white, str(perft_cases[case_i].fen), &search_state));
+            run_search_move(&searcher);
+            search_node_counts[eval_cache_enabled] += searcher.node_count;
+            search_time += searcher.search_time;
+            hit_count += searcher.eval_cache_hit_count;
+            miss_count += searcher.eval_cache_miss_count;
+        }
+        printf("%-18s %8.2f M nodes/s  nodes %llu  time %.2fs", eval_cache_enabled ? "search, eval cache" : "search",
+               search_node_counts[eval_cache_enabled] / search_time / 1e6, (unsigned long long)search_node_counts[eval_cache_enabled], search_time);
+        if (eval_cache_enabled)
+        {
+            printf("  hit rate %.1f%%", hit_count + miss_count ? 100.0 * hit_count / (hit_count + miss_count) : 0.0);
+        }
+        printf("\n");
+    }
+    ASSERT(search_node_counts[0] == search_node_counts[1]);
+}
+
+#if defined(NNUE_EVAL)
+// NOTE: What the square value network computes, material and middle game square values of everything but the kings
+Int get_square_value_nnue_eval(GameState *state)
+{
+    Int value = 0;
+    for (GameSideEnum side = 0; side < GameSide::count; side++)
+    {
+        for (GamePieceTypeEnum piece_type = 0; piece_type < GamePieceType::king; piece_type++)
+        {
+            BitBoard occupancy = get_occupancy(state, side, piece_type);
+            while (occupancy)
+            {
+                Square square = first_set(occupancy);
+                occupancy &= occupancy - 1;
+                Int piece_value = piece_material_values[piece_type] + piece_square_values[side][piece_type][square].middle;
+                value += side == state->current_side ? piece_value : -piece_value;
+            }
+        }
+    }
+    Int max_value = NNUE_RAMP_COUNT / 2 * NNUE_CLIP;
+    value = MIN(MAX(value, -max_value), max_value);
+    return value;
+}
+
+// NOTE: Incremental accumulators must match a refresh from scratch, and the square value network its expected value
+Int check_nnue_eval(GameState *state, Int depth, Bool square_value_network)
+{
+    Int error_count = 0;
+    Int value = eval_nnue(state, &state->nnue_accumulator);
+    NnueAccumulator accumulator = {};
+    if (eval_nnue(state, &accumulator) != value || memcmp(accumulator.value, state->nnue_accumulator.value, sizeof(accumulator.value)) != 0)
+    {
+        error_count++;
+    }
+    if (square_value_network && value != get_square_value_nnue_eval(state))
+    {
+        error_count++;
+    }
+    if (depth == 0)
+    {
+        return error_count;
+    }
+
+    GameMove moves_data[256];
+    Buffer<GameMove> moves;
+    moves.count = 0;
+    moves.data = moves_data;
+    generate_all_moves(state, &moves);
+    for (Int i = 0; i < moves.count; i++)
+    {
+        // NOTE: Rollback must give back the accumulators it started from, valid sides included
+        NnueAccumulator accumulator_before = state->nnue_accumulator;
+        record_game_move(state, moves[i]);
+        error_count += check_nnue_eval(state, depth - 1, square_value_network);
+        rollback_game_move(state, moves[i]);
+        if (memcmp(&accumulator_before, &state->nnue_accumulator, sizeof(accumulator_before)) != 0)
+        {
+            error_count++;
+        }
+    }
+    return error_count;
+}
+
+// NOTE: Make/unmake down the tree with an eval at every leaf, so the network side pays for its incremental updates
+Int64 run_leaf_eval(GameState *state, Int depth, Bool nnue, UInt64 *leaf_count)
+{
+    if (depth == 0)
+    {
+        (*leaf_count)++;
+        return nnue ? eval_nnue(state, &state->nnue_accumulator) : eval(state, state->current_side, &bench_pawn_table);
+    }
+
+    GameMove moves_data[256];
+    Buffer<GameMove> moves;
+    moves.count = 0;
+    moves.data = moves_data;
+    generate_all_moves(state, &moves);
+    Int64 sum = 0;
+    for (Int i = 0; i < moves.count; i++)
+    {
+        record_game_move(state, moves[i]);
+        sum += run_leaf_eval(state, depth - 1, nnue, leaf_count);
+        rollback_game_move(state, moves[i]);
+    }
+    return sum;
+}
+
+CStr nnue_match_fens[] = {
+    START_FEN,
+    "r1bqkbnr/pppp1ppp/2n5/1B2p3/4P3/5N2/PPPP1PPP/RNBQK2R b KQkq - 3 3",
+    "rnbqkbnr/pp2pppp/3p4/2p5/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 0 3",
+    "rnbqkbnr/ppp2ppp/4p3/3p4/2PP4/8/PP2PPPP/RNBQKBNR w KQkq - 0 3",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+};
+
+#define NNUE_MATCH_DEPTH (5)
+#define NNUE_MATCH_MAX_PLY (200)
+
+// NOTE: Every opening is played with both colors at a fixed depth, games still going at the ply limit count as draws
+Void run_nnue_match()
+{
+    GameState state;
+    Searcher searchers[2];
+    for (Int searcher_i = 0; searcher_i < 2; searcher_i++)
+    {
+        ASSERT(initialize_searcher(&searchers[searcher_i], &state, 1));
+        searchers[searcher_i].limit = get_depth_search_limit(NNUE_MATCH_DEPTH);
+        searchers[searcher_i].nnue_enabled = searcher_i == 1;
+        ASSERT(run_thread((ThreadFunc)search, &searchers[searcher_i]));
+    }
+
+    Int win_count = 0;
+    Int draw_count = 0;
+    Int lose_count = 0;
+    UInt64 node_counts[2] = {};
+    Real64 search_times[2] = {};
+    for (Int fen_i = 0; fen_i < (Int)(sizeof(nnue_match_fens) / sizeof(nnue_match_fens[0])); fen_i++)
+    {
+        for (GameSideEnum nnue_side = 0; nnue_side < GameSide::count; nnue_side++)
+        {
+            ASSERT(get_game_state_from_fen(nnue_side, str(nnue_match_fens[fen_i]), &state));
+            GameEndEnum game_end = GameEnd::none;
+            for (Int ply = 0; ply < NNUE_MATCH_MAX_PLY && game_end == GameEnd::none; ply++)
+            {
+                Int searcher_i = state.current_side == nnue_side ? 1 : 0;
+                Searcher *searcher = &searchers[searcher_i];
+                run_search_move(searcher);
+                node_counts[searcher_i] += searcher->node_count;
+                search_times[searcher_i] += searcher->search_time;
+                record_game_move_with_history(&state, searcher->best_move);
+                game_end = check_game_end(&state);
+            }
+            win_count += game_end == GameEnd::win;
+            draw_count += game_end == GameEnd::draw || game_end == GameEnd::none;
+            lose_count += game_end == GameEnd::lose;
+        }
+    }
+    printf("match at depth %d, network against classical: +%d =%d -%d\n", NNUE_MATCH_DEPTH, win_count, draw_count, lose_count);
+    printf("search speed classical %.0f nps  network %.0f nps\n", node_counts[0] / search_times[0], node_counts[1] / search_times[1]);
+}
+
+// NOTE: Without a weight file the square value network is used, written to the weight format and read back
+Bool run_nnue_bench(CStr weight_filename)
+{
+#if defined(__AVX2__)
+    printf("nnue kernels: avx2\n");
+#elif defined(__SSE4_1__)
+    printf("nnue kernels: sse4.1\n");
+#else
+    printf("nnue kernels: portable\n");
+#endif
+
+    NnueNetwork *network = (NnueNetwork *)malloc(sizeof(NnueNetwork));
+    ASSERT(network);
+    Bool square_value_network = !weight_filename;
+    if (weight_filename)
+    {
+        Str file_contents;
+        if (!map_file(weight_filename, &file_contents) || !deserialise_nnue_network(file_contents, network))
+        {
+            printf("failed to load %s\n", weight_filename);
+            return false;
+        }
+    }
+    else
+    {
+        NnueNetwork *square_value_network_data = (NnueNetwork *)malloc(sizeof(NnueNetwork));
+        ASSERT(square_value_network_data);
+        initialize_square_value_nnue_network(square_value_network_data);
+        Str buffer = serialise_nnue_network(square_value_network_data);
+        ASSERT(deserialise_nnue_network(buffer, network));
+        free(buffer.data);
+        free(square_value_network_data);
+    }
+    nnue_network = network;
+
+    Int error_count = 0;
+    for (Int case_i = 0; case_i < (Int)(sizeof(perft_cases) / sizeof(perft_cases[0])); case_i++)
+    {
+        GameState state;
+        ASSERT(get_game_state_from_fen(GameSide::white, str(perft_cases[case_i].fen), &state));
+        error_count += check_nnue_eval(&state, 3, square_value_network);
+    }
+    printf("%s\n", error_count ? "FAIL accumulator check" : "accumulator check passed");
+    if (error_count)
+    {
+        return false;
+    }
+
+    ASSERT(initialize_pawn_table(&bench_pawn_table));
+    for (Int nnue = 0; nnue <= 1; nnue++)
+    {
+        UInt64 leaf_count = 0;
+        Int64 sum = 0;
+        UInt64 timestamp = get_current_timestamp();
+        for (Int case_i = 0; case_i < (Int)(sizeof(perft_cases) / sizeof(perft_cases[0])); case_i++)
+        {
+            GameState state;
+            ASSERT(get_game_state_from_fen(GameSide::white, str(perft_cases[case_i].fen), &state));
+            sum += run_leaf_eval(&state, 3, nnue, &leaf_count);
+        }
+        Real64 time = get_elapsed_time(get_current_timestamp() - timestamp);
+        printf("%-18s %8.2f M leaves/s  (checksum %lld)\n", nnue ? "leaf eval (nnue)" : "leaf eval", leaf_count / time / 1e6, (long long)sum);
+    }
+    free(bench_pawn_table.entries);
+
+    run_nnue_match();
+    return true;
+}
+#endif
+
+Void print_usage()
+{
+    printf("usage: perft <depth> [fen]\n");
+    printf("       perft divide <depth> [fen]\n");
+    printf("       perft suite [max depth]\n");
+    printf("       perft see\n");
+    printf("       perft bench\n");
+#if defined(NNUE_EVAL)
+    printf("       perft nnue [weight file]\n");
+#endif
+}
+
+int main(Int argc, CStr *argv)
+{
+    argc--, argv++;
+
+    if (!check_cpu_features())
+    {
+        printf("this cpu lacks instructions the build targets\n");
+        return 1;
+    }
+
+#if defined(BIT_BOARD_TABLE_ASSET)
+    Str file_contents;
+    if (!map_file("asset/bitboard.asset", &file_contents) || !deserialise_bit_board_table(file_contents, &bit_board_table))
+    {
+        printf("failed to load asset/bitboard.asset\n");
+        return 1;
+    }
+#endif
+
+    RandomGenerator random_generator;
+    random_generator.seed = 0x5eed;
+    initialize_zobrist_keys(&random_generator);
+    initialize_eval_tables();
+
+    if (argc >= 1 && strcmp(argv[0], "suite") == 0)
+    {
+        Int max_depth = argc >= 2 ? atoi(argv[1]) : 6;
+        return run_suite(max_depth) ? 0 : 1;
+    }
+
+    if (argc >= 1 && strcmp(argv[0], "see") == 0)
+    {
+        return run_see_cases() ? 0 : 1;
+    }
+
+    if (argc >= 1 && strcmp(argv[0], "bench") == 0)
+    {
+        run_bench();
+        return 0;
+    }
+
+#if defined(NNUE_EVAL)
+    if (argc >= 1 && strcmp(argv[0], "nnue") == 0)
+    {
+        return run_nnue_bench(argc >= 2 ? argv[1] : NULL) ? 0 : 1;
+    }
+#endif
+
+    Bool is_divide = argc >= 1 && strcmp(argv[0], "divide") == 0;
+    if (is_divide)
+    {
+        argc--, argv++;
+    }
+    if (argc < 1 || atoi(argv[0]) < 1)
+    {
+        print_usage();
+        return 1;
+    }
+    Int depth = atoi(argv[0]);
+    CStr fen = argc >= 2 ? argv[1] : (CStr)START_FEN;
+
+    GameState state;
+    if (!get_game_state_from_fen(GameSide::white, str(fen), &state))
+    {
+        printf("invalid fen: %s\n", fen);
+        return 1;
+    }
+
+    UInt64 timestamp = get_current_timestamp();
+    UInt64 node_count = is_divide ? divide(&state, depth) : perft(&state, depth);
+    print_result(node_count, timestamp);
+    return 0;
+}
+
+#include "../lib/util.cpp"
+#include "../lib/os.cpp"
@@ -270,101 +270,6 @@ Bool deserialise_sound(Str buffer, Sound *sound)
     return true;
 }
 
-Bool deserialise_bit_board_table(Str buffer, BitBoardTable *table)
-{
-    Int move_data_length;
-    Int pos = 0;
-    for (Int square = 0; square < 64; square++)
-    {
-        SlidingPieceTableSquare *table_square = &table->rook_table.board[square];
-        if (buffer.count < pos + 8)
-        {
-            return false;
-        }
-        table_square->blocker_mask = *(BitBoard *)(buffer.data + pos);
-        pos += 8;
-
-        if (buffer.count < pos + 8)
-        {
-            return false;
-        }
-        table_square->blocker_bit_count = *(UInt64 *)(buffer.data + pos);
-        pos += 8;
-
-        if (buffer.count < pos + 8)
-        {
-            return false;
-        }
-        table_square->magic = *(UInt64 *)(buffer.data + pos);
-        pos += 8;
-
-        move_data_length = sizeof(BitBoard) * (1 << table_square->blocker_bit_count);
-        if (buffer.count < pos + move_data_length)
-        {
-            return false;
-        }
-        table_square->move = (BitBoard *)malloc(move_data_length);
-        memcpy(table_square->move, buffer.data + pos, move_data_length);
-        pos += move_data_length;
-    }
-
-    move_data_length = sizeof(BitBoard) * 64;
-    if (buffer.count < pos + move_data_length)
-    {
-        return false;
-    }
-    memcpy(&table->knight_table.move, buffer.data + pos, move_data_length);
-    pos += move_data_length;
-
-    for (Int square = 0; square < 64; square++)
-    {
-        SlidingPieceTableSquare *table_square = &table->bishop_table.board[square];
-        if (buffer.count < pos + 8)
-        {
-            return false;
-        }
-        table_square->blocker_mask = *(BitBoard *)(buffer.data + pos);
-        pos += 8;
-
-        if (buffer.count < pos + 8)
-        {
-            return false;
-        }
-        table_square->blocker_bit_count = *(UInt64 *)(buffer.data + pos);
-        pos += 8;
-
-        if (buffer.count < pos + 8)
-        {
-            return false;
-        }
-        table_square->magic = *(UInt64 *)(buffer.data + pos);
-        pos += 8;
-
-        move_data_length = sizeof(BitBoard) * (1 << table_square->blocker_bit_count);
-        if (buffer.count < pos + move_data_length)
-        {
-            return false;
-        }
-        table_square->move = (BitBoard *)malloc(move_data_length);
-        memcpy(table_square->move, buffer.data + pos, move_data_length);
-        pos += move_data_length;
-    }
-
-    move_data_length = sizeof(BitBoard) * 64;
-    if (buffer.count < pos + move_data_length)
-    {
-        return false;
-    }
-    memcpy(&table->king_table.move, buffer.data + pos, move_data_length);
-    pos += move_data_length;
-
-    if (buffer.count != pos)
-    {
-        return false;
-    }
-    return true;
-}
-
 struct AssetStore
 {
     Mesh board_mesh;
@@ -374,7 +279,6 @@ struct AssetStore
     BitmapFont debug_font;
     BitmapFont menu_fonts[MENU_FONT_COUNT];
     Sound sound_error;
-    BitBoardTable *bit_board_table;
 };
 
 Bool load_asset(AssetStore *asset_store)
@@ -507,10 +411,11 @@ Bool load_asset(AssetStore *asset_store)
         }
     }
 
-    if (read_file("asset/bitboard.asset", &file_contents))
+#if defined(BIT_BOARD_TABLE_ASSET)
+    // NOTE: Mapped rather than read, the table uses the attack arrays in place
+    if (map_file("asset/bitboard.asset", &file_contents))
     {
-        asset_store->bit_board_table = (BitBoardTable *)malloc(sizeof(BitBoardTable));
-        if (!asset_store->bit_board_table || !deserialise_bit_board_table(file_contents, asset_store->bit_board_table))
+        if (!deserialise_bit_board_table(file_contents, &bit_board_table))
         {
             return false;
         }
@@ -519,6 +424,7 @@ Bool load_asset(AssetStore *asset_store)
     {
         return false;
     }
+#endif
 
     return true;
 }
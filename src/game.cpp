@@ -1,5 +1,8 @@
 #pragma once
 #include "../lib/util.hpp"
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
 
 typedef UInt64 BitBoard;
 
@@ -112,17 +115,52 @@ struct SimplePieceTable
     BitBoard move[64];
 };
 
+// NOTE: Packed to 32 bytes so two headers share a cache line and none straddles one. The offsets index the moves of the
+// square in the attack arrays shared by both sliding tables. The magic index may have fewer bits than the blocker mask,
+// so the magic and the PEXT arrays have their own offsets.
 struct SlidingPieceTableSquare
 {
     BitBoard blocker_mask;
-    UInt64 blocker_bit_count;
     UInt64 magic;
-    BitBoard *move;
+    UInt32 offset;
+    UInt32 shift;
+    UInt32 pext_offset;
+    UInt32 blocker_bit_count;
 };
 
 struct SlidingPieceTable
 {
     SlidingPieceTableSquare board[64];
+    const BitBoard *move;
+    // NOTE: The same moves indexed by the blocker bits gathered with PEXT, only built for BMI2 targets
+    const BitBoard *pext_move;
+};
+
+// NOTE: Layout of the attack table asset. Every part is used or copied as is, the attack arrays start at 64 byte aligned
+// offsets after the fixed part and the square offsets index into them. The checksum covers everything after the header.
+#define BIT_BOARD_TABLE_FILE_MAGIC 0x54424243
+#define BIT_BOARD_TABLE_FILE_VERSION 1
+
+struct BitBoardTableFileHeader
+{
+    UInt32 magic;
+    UInt32 version;
+    UInt64 checksum;
+    UInt64 size;
+    UInt64 move_offset;
+    UInt64 move_count;
+    UInt64 pext_move_offset;
+    UInt64 pext_move_count;
+    UInt64 padding;
+};
+
+struct BitBoardTableFile
+{
+    BitBoardTableFileHeader header;
+    SlidingPieceTableSquare rook_board[64];
+    SlidingPieceTableSquare bishop_board[64];
+    BitBoard knight_move[64];
+    BitBoard king_move[64];
 };
 
 struct BitBoardTable
@@ -131,6 +169,11 @@ struct BitBoardTable
     SimplePieceTable knight_table;
     SlidingPieceTable bishop_table;
     SimplePieceTable king_table;
+
+    // NOTE: Derived from the sliding tables, not part of the asset.
+    // between: squares strictly between two aligned squares, line: the full line through two aligned squares.
+    BitBoard between[64][64];
+    BitBoard line[64][64];
 };
 
 // NOTE: Evaluation lookup table depends on this order.
@@ -192,6 +235,25 @@ constexpr Square get_abs_square(Square square, GameSideEnum side)
     return result;
 }
 
+// NOTE: Side known at compile time, relative squares of constant squares fold into constants
+template <GameSideEnum Side>
+constexpr Square get_row_rel(Square square)
+{
+    return get_row_rel(square, Side);
+}
+
+template <GameSideEnum Side>
+constexpr Square get_column_rel(Square square)
+{
+    return get_column_rel(square, Side);
+}
+
+template <GameSideEnum Side>
+constexpr Square get_abs_square(Square square)
+{
+    return get_abs_square(square, Side);
+}
+
 // NOTE: GamePiece is encoded with 4 bits
 // x(1)  xxx(3)
 // side  piece type
@@ -201,7 +263,7 @@ typedef UInt8 GamePiece;
 GamePiece get_game_piece(GameSideEnum side, GamePieceTypeEnum piece_type)
 {
     ASSERT(side >= 0 && side < GameSide::count);
-    ASSERT(piece_type >= 0 && GamePieceType::count);
+    ASSERT(piece_type >= 0 && piece_type < GamePieceType::count);
     GamePiece piece = piece_type | (side << 3);
     return piece;
 }
@@ -314,19 +376,82 @@ GameSideEnum get_side(GameMove move)
 
 #define MAX_HISTORY_COUNT (1000)
 
-struct GameState
+struct ValuePair
 {
-    BitBoardTable *bit_board_table;
-    GameSideEnum player_side;
+    Int middle;
+    Int end;
+};
 
-    GamePiece board[64];
+ValuePair operator+(ValuePair x, ValuePair y)
+{
+    ValuePair result;
+    result.middle = x.middle + y.middle;
+    result.end = x.end + y.end;
+    return result;
+}
+
+ValuePair operator-(ValuePair x, ValuePair y)
+{
+    ValuePair result;
+    result.middle = x.middle - y.middle;
+    result.end = x.end - y.end;
+    return result;
+}
+
+// NOTE: Filled in by the evaluation, the game state keeps running sums of these as pieces are added and removed
+Int piece_material_values[GamePieceType::count];
+Int piece_phase_values[GamePieceType::count];
+ValuePair piece_square_values[GameSide::count][GamePieceType::count][64];
+
+// NOTE: Ring of positions before each recorded move. Repetitions only reach back to the last irreversible move, which
+// the fifty move rule bounds well within the ring.
+#define MAX_POSITION_HISTORY_COUNT (256)
+#define POSITION_HISTORY_MASK (MAX_POSITION_HISTORY_COUNT - 1)
+
+struct PositionHistory
+{
+    UInt64 zobrist;
+    Int halfmove_clock;
+};
+
+// NOTE: Part of the game state that move generation and hashing need, small enough to copy per ply. Pieces on squares
+// are looked up from the bit boards, the board array and everything else stay in the game state.
+struct SearchPosition
+{
     BitBoard occupancy_side[GameSide::count];
     BitBoard occupancy_piece_type[GamePieceType::count];
+    UInt64 zobrist;
     GameSideEnum current_side;
     GameCastling castling;
     // TODO: En passant only needs to be encoded with 4 bits?
     Square en_passant;
-    UInt64 zobrist;
+};
+
+// NOTE: Build with NNUE_EVAL for the optional network evaluation, the accumulators are part of the game state
+#if defined(NNUE_EVAL)
+#include "nnue.cpp"
+#endif
+
+struct GameState : SearchPosition
+{
+    GameSideEnum player_side;
+    GamePiece board[64];
+    UInt64 pawn_zobrist;
+
+    Int material_pawn[GameSide::count];
+    Int material_non_pawn[GameSide::count];
+    ValuePair square_value[GameSide::count];
+    Int phase;
+#if defined(NNUE_EVAL)
+    NnueAccumulator nnue_accumulator;
+#endif
+
+    Int halfmove_clock;
+    PositionHistory position_history[MAX_POSITION_HISTORY_COUNT];
+    Int position_history_count;
+#if defined(NNUE_EVAL)
+    NnueAccumulatorHistory nnue_accumulator_history[MAX_POSITION_HISTORY_COUNT];
+#endif
 
     GameMove history[MAX_HISTORY_COUNT];
     Int history_count;
@@ -334,32 +459,61 @@ struct GameState
     Int undo_count;
 };
 
-BitBoard get_occupancy(GameState *state)
+BitBoard get_occupancy(SearchPosition *state)
 {
     BitBoard occupancy = state->occupancy_side[0] | state->occupancy_side[1];
     return occupancy;
 }
 
-BitBoard get_occupancy(GameState *state, GameSideEnum side, GamePieceTypeEnum piece_type)
+BitBoard get_occupancy(SearchPosition *state, GameSideEnum side, GamePieceTypeEnum piece_type)
 {
     BitBoard result = state->occupancy_side[side] & state->occupancy_piece_type[piece_type];
     return result;
 }
 
+GamePiece get_square_piece(SearchPosition *state, Square square)
+{
+    BitBoard square_bit = bit_square(square);
+    GameSideEnum side;
+    if (state->occupancy_side[GameSide::white] & square_bit)
+    {
+        side = GameSide::white;
+    }
+    else if (state->occupancy_side[GameSide::black] & square_bit)
+    {
+        side = GameSide::black;
+    }
+    else
+    {
+        return NO_GAME_PIECE;
+    }
+
+    for (GamePieceTypeEnum piece_type = 0; piece_type < GamePieceType::count; piece_type++)
+    {
+        if (state->occupancy_piece_type[piece_type] & square_bit)
+        {
+            GamePiece piece = get_game_piece(side, piece_type);
+            return piece;
+        }
+    }
+    ASSERT(false);
+    return NO_GAME_PIECE;
+}
+
 Bool is_empty(GamePiece piece)
 {
     Bool result = piece == NO_GAME_PIECE;
     return result;
 }
 
-Bool is_friend(GameState *state, GamePiece piece)
+Bool is_friend(SearchPosition *state, GamePiece piece)
 {
     GameSideEnum side = get_side(piece);
     Bool result = piece != NO_GAME_PIECE && state->current_side == side;
     return result;
 }
 
-Bool is_foe(GameState *state, GamePiece piece)
+Bool is_foe(SearchPosition *state, GamePiece piece)
 {
     GameSideEnum side = get_side(piece);
     Bool result = piece != NO_GAME_PIECE && state->current_side != side;
@@ -406,6 +560,25 @@ Void add_game_piece(GameState *state, Square square, GamePiece piece)
     state->occupancy_side[side] |= bit_square(square);
     state->occupancy_piece_type[piece_type] |= bit_square(square);
     state->zobrist ^= zobrist_square[side][piece_type][square];
+
+    if (piece_type == GamePieceType::pawn)
+    {
+        state->pawn_zobrist ^= zobrist_square[side][piece_type][square];
+        state->material_pawn[side] += piece_material_values[piece_type];
+    }
+    else
+    {
+        state->material_non_pawn[side] += piece_material_values[piece_type];
+    }
+    state->square_value[side] = state->square_value[side] + piece_square_values[side][piece_type][square];
+    state->phase += piece_phase_values[piece_type];
+
+#if defined(NNUE_EVAL)
+    if (nnue_network)
+    {
+        update_nnue_accumulator(&state->nnue_accumulator, state, square, piece, true);
+    }
+#endif
 }
 
 GamePiece remove_game_piece(GameState *state, Square square)
@@ -418,39 +591,57 @@ GamePiece remove_game_piece(GameState *state, Square square)
     state->occupancy_side[side] &= ~bit_square(square);
     state->occupancy_piece_type[piece_type] &= ~bit_square(square);
     state->zobrist ^= zobrist_square[side][piece_type][square];
+
+    if (piece_type == GamePieceType::pawn)
+    {
+        state->pawn_zobrist ^= zobrist_square[side][piece_type][square];
+        state->material_pawn[side] -= piece_material_values[piece_type];
+    }
+    else
+    {
+        state->material_non_pawn[side] -= piece_material_values[piece_type];
+    }
+    state->square_value[side] = state->square_value[side] - piece_square_values[side][piece_type][square];
+    state->phase -= piece_phase_values[piece_type];
+
+#if defined(NNUE_EVAL)
+    if (nnue_network)
+    {
+        update_nnue_accumulator(&state->nnue_accumulator, state, square, piece, false);
+    }
+#endif
     return piece;
 }
 
-Void update_current_side(GameState *state, GameSideEnum side)
+Void update_current_side(SearchPosition *state, GameSideEnum side)
 {
     state->zobrist ^= zobrist_side[state->current_side];
     state->current_side = side;
     state->zobrist ^= zobrist_side[state->current_side];
 }
 
-Void update_castling(GameState *state, GameCastling castling)
+Void update_castling(SearchPosition *state, GameCastling castling)
 {
     state->zobrist ^= zobrist_castling[state->castling];
     state->castling = castling;
     state->zobrist ^= zobrist_castling[state->castling];
 }
 
-Void update_en_passant(GameState *state, Square square)
+Void update_en_passant(SearchPosition *state, Square square)
 {
     state->zobrist ^= zobrist_en_passant[state->en_passant];
     state->en_passant = square;
     state->zobrist ^= zobrist_en_passant[state->en_passant];
 }
 
-GameState get_initial_game_state(BitBoardTable *bit_board_table, GameSideEnum player_side)
+GameState get_initial_game_state(GameSideEnum player_side)
 {
     GameState state = {};
-    state.bit_board_table = bit_board_table;
     state.player_side = player_side;
     state.current_side = GameSide::white;
     state.castling = GameCastlingMask::initial;
     state.en_passant = NO_SQUARE;
-    state.zobrist = zobrist_side[state.current_side] ^ zobrist_side[state.castling] ^ zobrist_en_passant[state.en_passant];
+    state.zobrist = zobrist_side[state.current_side] ^ zobrist_castling[state.castling] ^ zobrist_en_passant[state.en_passant];
 
     memset(state.board, NO_GAME_PIECE, sizeof(state.board));
     add_game_piece(&state, get_square(0, 0), get_game_piece(GameSide::white, GamePieceType::rook));
@@ -485,237 +676,1031 @@ GameState get_initial_game_state(BitBoardTable *bit_board_table, GameSideEnum pl
     return state;
 }
 
-BitBoard check_simple_piece_move(GameState *state, Square square, GameSideEnum side, SimplePieceTable *simple_piece_table)
+// NOTE: Read the first four fields of a FEN string: placement, side to move, castling and en passant
+Bool get_game_state_from_fen(GameSideEnum player_side, Str fen, GameState *state)
 {
-    BitBoard move = simple_piece_table->move[square] & ~state->occupancy_side[side];
-    return move;
-}
+    *state = {};
+    state->player_side = player_side;
+    state->current_side = GameSide::white;
+    state->castling = 0;
+    state->en_passant = NO_SQUARE;
+    state->zobrist = zobrist_side[state->current_side] ^ zobrist_castling[state->castling] ^ zobrist_en_passant[state->en_passant];
+    memset(state->board, NO_GAME_PIECE, sizeof(state->board));
 
-BitBoard check_knight_move(GameState *state, Square square, GameSideEnum side)
-{
-    BitBoard move = check_simple_piece_move(state, square, side, &state->bit_board_table->knight_table);
-    return move;
-}
+    CStr piece_chars = "pnbrqk";
+    Int pos = 0;
+    Square row = 7;
+    Square column = 0;
+    while (pos < fen.count && fen[pos] != ' ')
+    {
+        UInt8 c = fen[pos++];
+        if (c == '/')
+        {
+            if (column != 8 || row == 0)
+            {
+                return false;
+            }
+            row--;
+            column = 0;
+        }
+        else if (c >= '1' && c <= '8')
+        {
+            column += c - '0';
+            if (column > 8)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            GameSideEnum side = c >= 'a' ? GameSide::black : GameSide::white;
+            UInt8 lower_c = side == GameSide::white ? c - 'A' + 'a' : c;
+            CStr piece_char = strchr(piece_chars, lower_c);
+            if (!lower_c || !piece_char || column >= 8)
+            {
+                return false;
+            }
+            GamePieceTypeEnum piece_type = (GamePieceTypeEnum)(piece_char - piece_chars);
+            add_game_piece(state, get_square(row, column), get_game_piece(side, piece_type));
+            column++;
+        }
+    }
+    if (row != 0 || column != 8)
+    {
+        return false;
+    }
+    for (GameSideEnum side = 0; side < GameSide::count; side++)
+    {
+        if (bit_count(get_occupancy(state, side, GamePieceType::king)) != 1)
+        {
+            return false;
+        }
+    }
 
-BitBoard check_king_move(GameState *state, Square square, GameSideEnum side)
-{
-    BitBoard move = check_simple_piece_move(state, square, side, &state->bit_board_table->king_table);
-    return move;
+    pos++;
+    if (pos >= fen.count || (fen[pos] != 'w' && fen[pos] != 'b'))
+    {
+        return false;
+    }
+    update_current_side(state, fen[pos] == 'w' ? GameSide::white : GameSide::black);
+    pos += 2;
+
+    GameCastling castling = 0;
+    while (pos < fen.count && fen[pos] != ' ')
+    {
+        switch (fen[pos++])
+        {
+        case 'K':
+        {
+            castling |= get_castling_mask(GameSide::white, GameCastlingMask::king_side);
+        }
+        break;
+
+        case 'Q':
+        {
+            castling |= get_castling_mask(GameSide::white, GameCastlingMask::queen_side);
+        }
+        break;
+
+        case 'k':
+        {
+            castling |= get_castling_mask(GameSide::black, GameCastlingMask::king_side);
+        }
+        break;
+
+        case 'q':
+        {
+            castling |= get_castling_mask(GameSide::black, GameCastlingMask::queen_side);
+        }
+        break;
+
+        case '-':
+        {
+        }
+        break;
+
+        default:
+        {
+            return false;
+        }
+        break;
+        }
+    }
+    update_castling(state, castling);
+    pos++;
+
+    if (pos < fen.count && fen[pos] != '-')
+    {
+        if (pos + 1 >= fen.count || fen[pos] < 'a' || fen[pos] > 'h' || fen[pos + 1] < '1' || fen[pos + 1] > '8')
+        {
+            return false;
+        }
+        update_en_passant(state, get_square(fen[pos + 1] - '1', fen[pos] - 'a'));
+    }
+    while (pos < fen.count && fen[pos] != ' ')
+    {
+        pos++;
+    }
+    pos++;
+
+    Int halfmove_clock = 0;
+    while (pos < fen.count && fen[pos] >= '0' && fen[pos] <= '9')
+    {
+        halfmove_clock = halfmove_clock * 10 + (fen[pos++] - '0');
+    }
+    state->halfmove_clock = halfmove_clock;
+
+    state->history_count = 0;
+    state->history_index = 0;
+    state->undo_count = 0;
+    return true;
 }
 
-BitBoard check_sliding_piece_move(GameState *state, Square square, GameSideEnum side, SlidingPieceTable *sliding_piece_table)
+namespace SlidingPiece
 {
-    SlidingPieceTableSquare *table_square = &sliding_piece_table->board[square];
-    BitBoard occupancy = get_occupancy(state);
-    BitBoard blocker_mask = table_square->blocker_mask;
-    BitBoard blocker = blocker_mask & occupancy;
-    UInt64 hash = (blocker * table_square->magic) >> (64 - table_square->blocker_bit_count);
-    BitBoard move = table_square->move[hash] & ~state->occupancy_side[side];
-    return move;
+enum
+{
+    rook,
+    bishop,
+    count,
+};
 }
+typedef Int SlidingPieceEnum;
 
-BitBoard check_bishop_move(GameState *state, Square square, GameSideEnum side)
+// NOTE: Squares from the square along one direction, up to and including the first blocker
+constexpr BitBoard get_ray(Square square, Int row_step, Int column_step, BitBoard blocker)
 {
-    BitBoard move = check_sliding_piece_move(state, square, side, &state->bit_board_table->bishop_table);
-    return move;
+    BitBoard result = 0;
+    Int row = get_row(square) + row_step;
+    Int column = get_column(square) + column_step;
+    while (row >= 0 && row < 8 && column >= 0 && column < 8)
+    {
+        BitBoard square_bit = 1llu << (row * 8 + column);
+        result |= square_bit;
+        if (blocker & square_bit)
+        {
+            break;
+        }
+        row += row_step;
+        column += column_step;
+    }
+    return result;
 }
 
-BitBoard check_rook_move(GameState *state, Square square, GameSideEnum side)
+// NOTE: The first two directions of each piece go towards higher squares
+constexpr Int sliding_row_steps[SlidingPiece::count][4] = {{1, 0, -1, 0}, {1, 1, -1, -1}};
+constexpr Int sliding_column_steps[SlidingPiece::count][4] = {{0, 1, 0, -1}, {1, -1, 1, -1}};
+
+struct SlidingRayTable
 {
-    BitBoard move = check_sliding_piece_move(state, square, side, &state->bit_board_table->rook_table);
-    return move;
-}
+    BitBoard ray[SlidingPiece::count][4][64];
+};
 
-BitBoard check_queen_move(GameState *state, Square square, GameSideEnum side)
+constexpr SlidingRayTable get_sliding_ray_table()
 {
-    BitBoard move = check_sliding_piece_move(state, square, side, &state->bit_board_table->bishop_table);
-    move |= check_sliding_piece_move(state, square, side, &state->bit_board_table->rook_table);
-    return move;
+    SlidingRayTable table = {};
+    for (SlidingPieceEnum piece = 0; piece < SlidingPiece::count; piece++)
+    {
+        for (Int i = 0; i < 4; i++)
+        {
+            for (Square square = 0; square < 64; square++)
+            {
+                table.ray[piece][i][square] = get_ray(square, sliding_row_steps[piece][i], sliding_column_steps[piece][i], 0);
+            }
+        }
+    }
+    return table;
 }
 
-#define LEFT_SIDE_MASK (0xfefefefefefefefellu)
-#define RIGHT_SIDE_MASK (0x7f7f7f7f7f7f7f7fllu)
+constexpr SlidingRayTable sliding_ray_table = get_sliding_ray_table();
 
-BitBoard left(BitBoard pawn_bit, GameSideEnum side)
+// NOTE: Each ray is cut after its first blocker, the lowest one for directions towards higher squares and the highest
+// one otherwise
+constexpr BitBoard get_sliding_move(Square square, SlidingPieceEnum piece, BitBoard blocker)
 {
-    BitBoard result = side == GameSide::white ? ((pawn_bit << 1) & RIGHT_SIDE_MASK) : ((pawn_bit >> 1) & LEFT_SIDE_MASK);
+    BitBoard result = 0;
+    for (Int i = 0; i < 4; i++)
+    {
+        BitBoard ray = sliding_ray_table.ray[piece][i][square];
+        BitBoard blocked = ray & blocker;
+        if (blocked)
+        {
+            if (i < 2)
+            {
+                ray &= ((blocked & -blocked) << 1) - 1;
+            }
+            else
+            {
+                blocked |= blocked >> 1;
+                blocked |= blocked >> 2;
+                blocked |= blocked >> 4;
+                blocked |= blocked >> 8;
+                blocked |= blocked >> 16;
+                blocked |= blocked >> 32;
+                ray &= ~((blocked ^ (blocked >> 1)) - 1);
+            }
+        }
+        result |= ray;
+    }
     return result;
 }
 
-BitBoard right(BitBoard pawn_bit, GameSideEnum side)
+// NOTE: Squares whose occupancy changes the sliding move, the last square of every direction never blocks anything
+constexpr BitBoard get_blocker_mask(Square square, SlidingPieceEnum piece)
 {
-    BitBoard result = left(pawn_bit, oppose(side));
+    BitBoard result = 0;
+    for (Int i = 0; i < 4; i++)
+    {
+        Int row_step = sliding_row_steps[piece][i];
+        Int column_step = sliding_column_steps[piece][i];
+        Int row = get_row(square) + row_step;
+        Int column = get_column(square) + column_step;
+        while (row + row_step >= 0 && row + row_step < 8 && column + column_step >= 0 && column + column_step < 8)
+        {
+            result |= bit_square(get_square(row, column));
+            row += row_step;
+            column += column_step;
+        }
+    }
     return result;
 }
 
-BitBoard up(BitBoard pawn_bit, GameSideEnum side)
+constexpr Int get_blocker_bit_count(BitBoard blocker_mask)
 {
-    BitBoard result = side == GameSide::white ? (pawn_bit << 8) : (pawn_bit >> 8);
+    Int result = 0;
+    while (blocker_mask)
+    {
+        blocker_mask &= blocker_mask - 1;
+        result++;
+    }
     return result;
 }
 
-BitBoard down(BitBoard pawn_bit, GameSideEnum side)
+constexpr BitBoard get_step_move(Square square, const Int *row_steps, const Int *column_steps)
 {
-    BitBoard result = up(pawn_bit, oppose(side));
+    BitBoard result = 0;
+    for (Int i = 0; i < 8; i++)
+    {
+        Int row = get_row(square) + row_steps[i];
+        Int column = get_column(square) + column_steps[i];
+        if (row >= 0 && row < 8 && column >= 0 && column < 8)
+        {
+            result |= bit_square(get_square(row, column));
+        }
+    }
     return result;
 }
 
-BitBoard up_left(BitBoard pawn_bit, GameSideEnum side)
+constexpr BitBoard get_knight_move(Square square)
 {
-    BitBoard result = side == GameSide::white ? ((pawn_bit << 7) & RIGHT_SIDE_MASK) : ((pawn_bit >> 9) & LEFT_SIDE_MASK);
-    return result;
+    constexpr Int row_steps[8] = {2, 1, 2, 1, -2, -1, -2, -1};
+    constexpr Int column_steps[8] = {1, 2, -1, -2, -1, -2, 1, 2};
+    return get_step_move(square, row_steps, column_steps);
 }
 
-BitBoard down_right(BitBoard pawn_bit, GameSideEnum side)
+constexpr BitBoard get_king_move(Square square)
 {
-    BitBoard result = up_left(pawn_bit, oppose(side));
-    return result;
+    constexpr Int row_steps[8] = {1, 1, 1, 0, 0, -1, -1, -1};
+    constexpr Int column_steps[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+    return get_step_move(square, row_steps, column_steps);
 }
 
-BitBoard up_right(BitBoard pawn_bit, GameSideEnum side)
+// NOTE: Magics found by the bitboard tool, the same ones stored in asset/bitboard.asset
+constexpr UInt64 rook_magics[64] = {
+    0x2380004000201080llu, 0x2040100020004001llu, 0x0180086002100080llu, 0x4080048008021000llu,
+    0x0a00086004100200llu, 0x0080018004004200llu, 0x0400640810030082llu, 0x4280014100102080llu,
+    0x080a002600450080llu, 0x4005004004802100llu, 0x0081004104102000llu, 0x3441000921021000llu,
+    0x0002002010460008llu, 0x0806001004020008llu, 0x3541002100140200llu, 0x0025000260810002llu,
+    0x00800040042002d2llu, 0x0010104000442000llu, 0x0050028010802000llu, 0x00f0008028001080llu,
+    0x0008008008040080llu, 0x0001010008240002llu, 0x08810c0008810210llu, 0x120916000080410cllu,
+    0x0c80084040002000llu, 0x0000200640005006llu, 0x0051410100200091llu, 0x1202000a00201241llu,
+    0x0021080100050010llu, 0x0242001200190410llu, 0x00001a1400081011llu, 0x0001204200140091llu,
+    0x7240604000800088llu, 0x1100442000401000llu, 0x0204102001004100llu, 0x4006102202004008llu,
+    0x0028010400800881llu, 0x2506001042000804llu, 0x0000011004000a08llu, 0x018100440a000081llu,
+    0x0180002000424000llu, 0x0010002000404000llu, 0x2001012002410010llu, 0x040200c010220008llu,
+    0x010008010011000cllu, 0x00020050040a0008llu, 0x54840928100400a2llu, 0x202010804b0e0014llu,
+    0x1500208000410100llu, 0x0030002010400040llu, 0x000142a000110500llu, 0x0268001000800880llu,
+    0x2502100500080100llu, 0x100a010804101200llu, 0x0009000a00244100llu, 0x2440028924044200llu,
+    0x4404208001004011llu, 0x1481024001801121llu, 0x0010110040082001llu, 0x4241008804100121llu,
+    0x0206004520181002llu, 0x4402000821141042llu, 0x000000821008011cllu, 0x1100511024004082llu,
+};
+
+constexpr UInt64 bishop_magics[64] = {
+    0x0504040402740101llu, 0x1008080108520002llu, 0x4010548200420008llu, 0x4068218320074150llu,
+    0x0004070800000c48llu, 0x0086021004044120llu, 0x0001080210040120llu, 0x0000710801042080llu,
+    0x06101c0410040104llu, 0x0400100102140140llu, 0x0b1a040400820200llu, 0x2103041400980200llu,
+    0x0888020210004604llu, 0x0400420802480000llu, 0x0004142c02184440llu, 0x0000083404040414llu,
+    0x0804062220040104llu, 0x0008011005080880llu, 0x00010288020c0050llu, 0x0044028803c01000llu,
+    0x0044022206110000llu, 0x0000201202052014llu, 0x027400004d280800llu, 0x2022024040440418llu,
+    0x0020050610041840llu, 0x001008015c080084llu, 0x2004410130030204llu, 0x0820080309010420llu,
+    0x000404002041004dllu, 0x0064110018b00200llu, 0x00c4440023030108llu, 0x4081002b27040100llu,
+    0x4801100804c00841llu, 0x0008020804020800llu, 0x0004402801100040llu, 0x0150110801040040llu,
+    0x028c024010040100llu, 0x21d0008602682200llu, 0x2004008400320158llu, 0x02a2205202190080llu,
+    0x0018022822004440llu, 0x6004010402001090llu, 0x403201a201020811llu, 0x0354034600800804llu,
+    0x0a45041008840400llu, 0x1c02203c04210300llu, 0x3208020400401400llu, 0x0041430311003200llu,
+    0x018d049010081048llu, 0x6010420203200280llu, 0x40012a0305211020llu, 0x44c0108061882000llu,
+    0x00880010020a1004llu, 0x6000101210010820llu, 0x004004010c0d0209llu, 0x1050060200520060llu,
+    0x2000610108200280llu, 0x2000008044100441llu, 0x250c000265081809llu, 0x2480011000840400llu,
+    0x001c020031020604llu, 0x010c018a30100081llu, 0x4100262004011200llu, 0x0012200101010504llu,
+};
+
+constexpr UInt64 get_magic(Square square, SlidingPieceEnum piece)
 {
-    BitBoard result = side == GameSide::white ? ((pawn_bit << 9) & LEFT_SIDE_MASK) : ((pawn_bit >> 7) & RIGHT_SIDE_MASK);
-    return result;
+    return piece == SlidingPiece::rook ? rook_magics[square] : bishop_magics[square];
 }
 
-BitBoard down_left(BitBoard pawn_bit, GameSideEnum side)
+template <Int N>
+struct SlidingMoveTable
 {
-    BitBoard result = up_right(pawn_bit, oppose(side));
+    BitBoard move[N];
+};
+
+// NOTE: Every blocker subset of the mask is enumerated with the carry rippler trick and hashed with the magic. Each
+// square is its own constant so that no single compile time evaluation gets too long.
+template <SlidingPieceEnum Piece, Int S>
+constexpr SlidingMoveTable<1 << get_blocker_bit_count(get_blocker_mask(S, Piece))> get_sliding_move_table()
+{
+    SlidingMoveTable<1 << get_blocker_bit_count(get_blocker_mask(S, Piece))> result = {};
+    BitBoard blocker_mask = get_blocker_mask(S, Piece);
+    Int blocker_bit_count = get_blocker_bit_count(blocker_mask);
+    UInt64 magic = get_magic(S, Piece);
+    BitBoard blocker = 0;
+    do
+    {
+        result.move[(blocker * magic) >> (64 - blocker_bit_count)] = get_sliding_move(S, Piece, blocker);
+        blocker = (blocker - blocker_mask) & blocker_mask;
+    } while (blocker);
     return result;
 }
 
-BitBoard get_row_mask(Square row)
+template <SlidingPieceEnum Piece, Int S>
+constexpr auto sliding_move_table = get_sliding_move_table<Piece, S>();
+
+// NOTE: The carry rippler visits blocker subsets in increasing PEXT index, so the PEXT table is the moves in visiting order
+template <SlidingPieceEnum Piece, Int S>
+constexpr SlidingMoveTable<1 << get_blocker_bit_count(get_blocker_mask(S, Piece))> get_sliding_pext_move_table()
 {
-    ASSERT(row >= 0 && row < 8);
-    BitBoard result = 0xff << row;
+    SlidingMoveTable<1 << get_blocker_bit_count(get_blocker_mask(S, Piece))> result = {};
+    BitBoard blocker_mask = get_blocker_mask(S, Piece);
+    BitBoard blocker = 0;
+    Int index = 0;
+    do
+    {
+        result.move[index++] = get_sliding_move(S, Piece, blocker);
+        blocker = (blocker - blocker_mask) & blocker_mask;
+    } while (blocker);
     return result;
 }
 
-BitBoard get_column_mask(Square column)
+template <SlidingPieceEnum Piece, Int S>
+constexpr auto sliding_pext_move_table = get_sliding_pext_move_table<Piece, S>();
+
+template <Int... Squares>
+struct SquareList
 {
-    ASSERT(column >= 0 && column < 8);
-    BitBoard result = LEFT_SIDE_MASK << column;
-    return result;
-}
+};
 
-BitBoard get_forward_mask(Square row, GameSideEnum side)
+template <Int N, Int... Squares>
+struct MakeSquareList : MakeSquareList<N - 1, N - 1, Squares...>
 {
-    ASSERT(row >= 0 && row < 8);
-    BitBoard result = (BitBoard(-1)) << (8 * row);
-    result = side == GameSide::white ? result << 8 : ~result;
-    return result;
-}
+};
 
-BitBoard check_pawn_move(GameState *state, Square square, GameSideEnum side)
+template <Int... Squares>
+struct MakeSquareList<0, Squares...>
 {
-    BitBoard move = 0;
-    BitBoard occupancy = get_occupancy(state);
-    BitBoard square_bit = bit_square(square);
-    BitBoard start_squares = side == GameSide::white ? ~(((UInt64)-1) << 8) << 8 : ~(((UInt64)-1) >> 8) >> 8;
-    Bool is_start = square_bit & start_squares;
+    typedef SquareList<Squares...> Type;
+};
 
-    square_bit = up(square_bit, side);
-    move |= square_bit & ~occupancy;
+struct SlidingMoveOffsetTable
+{
+    UInt32 offset[SlidingPiece::count][64];
+    Int count;
+};
 
-    if (is_start && move)
+// NOTE: Rook squares come first and bishop squares follow in the shared attack array, without overlapping
+constexpr SlidingMoveOffsetTable get_sliding_move_offset_table()
+{
+    SlidingMoveOffsetTable table = {};
+    Int offset = 0;
+    for (SlidingPieceEnum piece = 0; piece < SlidingPiece::count; piece++)
     {
-        square_bit = up(square_bit, side);
-        move |= square_bit & ~occupancy;
+        for (Square square = 0; square < 64; square++)
+        {
+            table.offset[piece][square] = offset;
+            offset += 1 << get_blocker_bit_count(get_blocker_mask(square, piece));
+        }
     }
-    return move;
+    table.count = offset;
+    return table;
 }
 
-BitBoard check_pawn_capture(GameState *state, Square square, GameSideEnum side)
+constexpr SlidingMoveOffsetTable sliding_move_offset_table = get_sliding_move_offset_table();
+
+struct SlidingMoveData
 {
-    BitBoard square_bit = bit_square(square);
-    BitBoard oppose_occupancy = state->occupancy_side[oppose(side)];
-    if (state->en_passant != NO_SQUARE)
+    alignas(64) BitBoard move[sliding_move_offset_table.count];
+};
+
+template <Int N>
+constexpr Int copy_sliding_move_table(SlidingMoveData *data, Int offset, const SlidingMoveTable<N> &table)
+{
+    for (Int i = 0; i < N; i++)
     {
-        oppose_occupancy |= bit_square(state->en_passant);
+        data->move[offset + i] = table.move[i];
     }
+    return N;
+}
 
-    BitBoard move = 0;
-    move |= up_left(square_bit, side) & oppose_occupancy;
-    move |= up_right(square_bit, side) & oppose_occupancy;
-    return move;
+// NOTE: The per square tables are only read at compile time to fill the contiguous array, so they are not emitted
+template <Int... Squares>
+constexpr SlidingMoveData get_sliding_move_data(SquareList<Squares...>)
+{
+    SlidingMoveData data = {};
+    Int rook_counts[] = {copy_sliding_move_table(&data, sliding_move_offset_table.offset[SlidingPiece::rook][Squares], sliding_move_table<SlidingPiece::rook, Squares>)...};
+    Int bishop_counts[] = {copy_sliding_move_table(&data, sliding_move_offset_table.offset[SlidingPiece::bishop][Squares], sliding_move_table<SlidingPiece::bishop, Squares>)...};
+    (Void)rook_counts;
+    (Void)bishop_counts;
+    return data;
 }
 
-BitBoard check_castling_move(GameState *state, GameSideEnum side)
+constexpr SlidingMoveData sliding_move_data = get_sliding_move_data(MakeSquareList<64>::Type());
+
+#if defined(__BMI2__)
+template <Int... Squares>
+constexpr SlidingMoveData get_sliding_pext_move_data(SquareList<Squares...>)
 {
-    BitBoard occupancy = get_occupancy(state);
-    BitBoard move = 0;
-    if (state->castling & get_castling_mask(side, GameCastlingMask::queen_side))
-    {
-        BitBoard blocker_mask = side == GameSide::white ? 0xellu : 0xellu << 56;
-        if (!(blocker_mask & occupancy))
-        {
-            BitBoard move_to = side == GameSide::white ? 0x4llu : 0x4llu << 56;
-            move |= move_to;
-        }
-    }
+    SlidingMoveData data = {};
+    Int rook_counts[] = {copy_sliding_move_table(&data, sliding_move_offset_table.offset[SlidingPiece::rook][Squares], sliding_pext_move_table<SlidingPiece::rook, Squares>)...};
+    Int bishop_counts[] = {copy_sliding_move_table(&data, sliding_move_offset_table.offset[SlidingPiece::bishop][Squares], sliding_pext_move_table<SlidingPiece::bishop, Squares>)...};
+    (Void)rook_counts;
+    (Void)bishop_counts;
+    return data;
+}
 
-    if (state->castling & get_castling_mask(side, GameCastlingMask::king_side))
+constexpr SlidingMoveData sliding_pext_move_data = get_sliding_pext_move_data(MakeSquareList<64>::Type());
+#endif
+
+template <SlidingPieceEnum Piece, Int... Squares>
+constexpr SlidingPieceTable get_sliding_piece_table(SquareList<Squares...>)
+{
+    SlidingPieceTable table = {{{get_blocker_mask(Squares, Piece), get_magic(Squares, Piece), sliding_move_offset_table.offset[Piece][Squares],
+                                 (UInt32)(64 - get_blocker_bit_count(get_blocker_mask(Squares, Piece))), sliding_move_offset_table.offset[Piece][Squares],
+                                 (UInt32)get_blocker_bit_count(get_blocker_mask(Squares, Piece))}...}};
+    table.move = sliding_move_data.move;
+#if defined(__BMI2__)
+    table.pext_move = sliding_pext_move_data.move;
+#else
+    table.pext_move = NULL;
+#endif
+    return table;
+}
+
+// NOTE: between: squares strictly between two aligned squares, line: the full line through two aligned squares
+constexpr Void initialize_line_table(BitBoardTable *table)
+{
+    constexpr Int row_steps[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+    constexpr Int column_steps[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+    for (Square square_a = 0; square_a < 64; square_a++)
+    {
+        for (Square square_b = 0; square_b < 64; square_b++)
+        {
+            table->between[square_a][square_b] = 0;
+            table->line[square_a][square_b] = 0;
+        }
+
+        for (Int i = 0; i < 8; i++)
+        {
+            BitBoard line = get_ray(square_a, row_steps[i], column_steps[i], 0) | get_ray(square_a, -row_steps[i], -column_steps[i], 0) | bit_square(square_a);
+            BitBoard between = 0;
+            Int row = get_row(square_a) + row_steps[i];
+            Int column = get_column(square_a) + column_steps[i];
+            while (row >= 0 && row < 8 && column >= 0 && column < 8)
+            {
+                Square square_b = get_square(row, column);
+                table->between[square_a][square_b] = between;
+                table->line[square_a][square_b] = line;
+                between |= bit_square(square_b);
+                row += row_steps[i];
+                column += column_steps[i];
+            }
+        }
+    }
+}
+
+constexpr BitBoardTable get_bit_board_table()
+{
+    BitBoardTable table = {};
+    table.rook_table = get_sliding_piece_table<SlidingPiece::rook>(MakeSquareList<64>::Type());
+    table.bishop_table = get_sliding_piece_table<SlidingPiece::bishop>(MakeSquareList<64>::Type());
+    for (Square square = 0; square < 64; square++)
+    {
+        table.knight_table.move[square] = get_knight_move(square);
+        table.king_table.move[square] = get_king_move(square);
+    }
+    initialize_line_table(&table);
+    return table;
+}
+
+// NOTE: Reorder the magic indexed moves by PEXT index, the asset only stores the magic tables
+Void initialize_pext_move(const SlidingPieceTable *table, BitBoard *pext_move)
+{
+    for (Square square = 0; square < 64; square++)
+    {
+        const SlidingPieceTableSquare *table_square = &table->board[square];
+        BitBoard blocker_mask = table_square->blocker_mask;
+        BitBoard blocker = 0;
+        Int index = table_square->pext_offset;
+        do
+        {
+            pext_move[index++] = table->move[table_square->offset + ((blocker * table_square->magic) >> table_square->shift)];
+            blocker = (blocker - blocker_mask) & blocker_mask;
+        } while (blocker);
+    }
+}
+
+// NOTE: The attack array is cache aligned by hand and never freed, the table lives as long as the program
+BitBoard *allocate_sliding_move(Int move_count)
+{
+    UInt8 *data = (UInt8 *)malloc(sizeof(BitBoard) * move_count + 63);
+    BitBoard *move = (BitBoard *)(((UInt64)data + 63) & ~63ull);
+    return move;
+}
+
+// NOTE: The PEXT lookup and initialize_pext_move both walk every subset of the blocker mask, so the bit count has to
+// agree with the mask for the PEXT bounds to hold
+Bool check_sliding_piece_table(SlidingPieceTable *table, UInt64 move_count, UInt64 *pext_move_count)
+{
+    for (Square square = 0; square < 64; square++)
+    {
+        SlidingPieceTableSquare *table_square = &table->board[square];
+        if (table_square->blocker_bit_count > 12 || table_square->blocker_bit_count != (UInt32)get_blocker_bit_count(table_square->blocker_mask) ||
+            table_square->shift < 64 - 12 || table_square->shift >= 64 ||
+            (UInt64)table_square->offset + (1ull << (64 - table_square->shift)) > move_count)
+        {
+            return false;
+        }
+        *pext_move_count = MAX(*pext_move_count, (UInt64)table_square->pext_offset + (1ull << table_square->blocker_bit_count));
+    }
+    return true;
+}
+
+Void initialize_copied_sliding_move(BitBoardTable *table, BitBoard *move, Int pext_move_count)
+{
+    table->rook_table.move = move;
+    table->bishop_table.move = move;
+
+#if defined(__BMI2__)
+    BitBoard *pext_move = allocate_sliding_move(pext_move_count);
+    initialize_pext_move(&table->rook_table, pext_move);
+    initialize_pext_move(&table->bishop_table, pext_move);
+    table->rook_table.pext_move = pext_move;
+    table->bishop_table.pext_move = pext_move;
+#else
+    (Void)pext_move_count;
+    table->rook_table.pext_move = NULL;
+    table->bishop_table.pext_move = NULL;
+#endif
+
+    initialize_line_table(table);
+}
+
+// NOTE: Original layout, every square stores its blocker mask, blocker bit count and magic followed by its own moves.
+// The squares are laid out back to back so the first pass only counts the moves, the second one copies them.
+Bool deserialise_per_square_sliding_piece_table(Str buffer, Int *pos, SlidingPieceTable *table, BitBoard *move, Int *move_count)
+{
+    for (Square square = 0; square < 64; square++)
     {
-        BitBoard blocker_mask = side == GameSide::white ? 0x60llu : 0x60llu << 56;
+        if (buffer.count < *pos + 24)
+        {
+            return false;
+        }
+        BitBoard blocker_mask = *(UInt64 *)(buffer.data + *pos);
+        UInt64 blocker_bit_count = *(UInt64 *)(buffer.data + *pos + 8);
+        UInt64 magic = *(UInt64 *)(buffer.data + *pos + 16);
+        *pos += 24;
+        if (blocker_bit_count > 12 || (UInt64)get_blocker_bit_count(blocker_mask) != blocker_bit_count)
+        {
+            return false;
+        }
+
+        Int move_data_length = sizeof(BitBoard) << blocker_bit_count;
+        if (buffer.count < *pos + move_data_length)
+        {
+            return false;
+        }
+        SlidingPieceTableSquare *table_square = &table->board[square];
+        table_square->blocker_mask = blocker_mask;
+        table_square->magic = magic;
+        table_square->offset = *move_count;
+        table_square->shift = 64 - blocker_bit_count;
+        table_square->pext_offset = *move_count;
+        table_square->blocker_bit_count = blocker_bit_count;
+        if (move)
+        {
+            memcpy(move + *move_count, buffer.data + *pos, move_data_length);
+        }
+        *pos += move_data_length;
+        *move_count += 1 << blocker_bit_count;
+    }
+    return true;
+}
+
+Bool deserialise_per_square_bit_board_table(Str buffer, BitBoardTable *table)
+{
+    BitBoard *move = NULL;
+    for (Int pass = 0; pass < 2; pass++)
+    {
+        Int move_data_length = sizeof(BitBoard) * 64;
+        Int move_count = 0;
+        Int pos = 0;
+        if (!deserialise_per_square_sliding_piece_table(buffer, &pos, &table->rook_table, move, &move_count))
+        {
+            return false;
+        }
+        if (buffer.count < pos + move_data_length)
+        {
+            return false;
+        }
+        memcpy(&table->knight_table.move, buffer.data + pos, move_data_length);
+        pos += move_data_length;
+
+        if (!deserialise_per_square_sliding_piece_table(buffer, &pos, &table->bishop_table, move, &move_count))
+        {
+            return false;
+        }
+        if (buffer.count != pos + move_data_length)
+        {
+            return false;
+        }
+        memcpy(&table->king_table.move, buffer.data + pos, move_data_length);
+
+        if (move)
+        {
+            initialize_copied_sliding_move(table, move, move_count);
+        }
+        else
+        {
+            UInt64 pext_move_count = 0;
+            if (!check_sliding_piece_table(&table->rook_table, move_count, &pext_move_count) ||
+                !check_sliding_piece_table(&table->bishop_table, move_count, &pext_move_count))
+            {
+                return false;
+            }
+            move = allocate_sliding_move(move_count);
+        }
+    }
+    return true;
+}
+
+UInt64 get_bit_board_table_checksum(const UInt8 *data, Int count)
+{
+    UInt64 checksum = 0xcbf29ce484222325ull;
+    for (Int i = 0; i + 8 <= count; i += 8)
+    {
+        checksum = (checksum ^ *(UInt64 *)(data + i)) * 0x100000001b3ull;
+    }
+    return checksum;
+}
+
+// NOTE: The attack arrays are used in place, so the buffer must stay alive as long as the table. Loaded with map_file
+// every process shares the same read only pages.
+Bool deserialise_versioned_bit_board_table(Str buffer, BitBoardTable *table)
+{
+    if (buffer.count < (Int)sizeof(BitBoardTableFileHeader))
+    {
+        return false;
+    }
+    BitBoardTableFileHeader *header = (BitBoardTableFileHeader *)buffer.data;
+    if (header->version != BIT_BOARD_TABLE_FILE_VERSION || header->size != (UInt64)buffer.count)
+    {
+        return false;
+    }
+    if (header->checksum != get_bit_board_table_checksum(buffer.data + sizeof(BitBoardTableFileHeader), buffer.count - sizeof(BitBoardTableFileHeader)))
+    {
+        return false;
+    }
+    if (header->move_offset % 64 != 0 || header->move_offset < sizeof(BitBoardTableFile) || header->move_offset > header->size ||
+        header->move_count > (header->size - header->move_offset) / sizeof(BitBoard))
+    {
+        return false;
+    }
+    if (header->pext_move_offset % 64 != 0 || header->pext_move_offset < sizeof(BitBoardTableFile) || header->pext_move_offset > header->size ||
+        header->pext_move_count > (header->size - header->pext_move_offset) / sizeof(BitBoard))
+    {
+        return false;
+    }
+
+    BitBoardTableFile *file = (BitBoardTableFile *)buffer.data;
+    memcpy(&table->rook_table.board, &file->rook_board, sizeof(file->rook_board));
+    memcpy(&table->bishop_table.board, &file->bishop_board, sizeof(file->bishop_board));
+    memcpy(&table->knight_table.move, &file->knight_move, sizeof(file->knight_move));
+    memcpy(&table->king_table.move, &file->king_move, sizeof(file->king_move));
+
+    UInt64 pext_move_count = 0;
+    if (!check_sliding_piece_table(&table->rook_table, header->move_count, &pext_move_count) ||
+        !check_sliding_piece_table(&table->bishop_table, header->move_count, &pext_move_count) || pext_move_count > header->pext_move_count)
+    {
+        return false;
+    }
+    const BitBoard *move = (const BitBoard *)(buffer.data + header->move_offset);
+    table->rook_table.move = move;
+    table->bishop_table.move = move;
+
+#if defined(__BMI2__)
+    const BitBoard *pext_move = (const BitBoard *)(buffer.data + header->pext_move_offset);
+#else
+    const BitBoard *pext_move = NULL;
+#endif
+    table->rook_table.pext_move = pext_move;
+    table->bishop_table.pext_move = pext_move;
+
+    initialize_line_table(table);
+    return true;
+}
+
+Bool deserialise_bit_board_table(Str buffer, BitBoardTable *table)
+{
+    if (buffer.count >= 4 && *(UInt32 *)buffer.data == BIT_BOARD_TABLE_FILE_MAGIC)
+    {
+        return deserialise_versioned_bit_board_table(buffer, table);
+    }
+    return deserialise_per_square_bit_board_table(buffer, table);
+}
+
+// NOTE: Attack tables are generated at compile time into read only data and used directly as a global. Build with
+// BIT_BOARD_TABLE_ASSET to load them from asset/bitboard.asset at startup instead.
+#if defined(BIT_BOARD_TABLE_ASSET)
+BitBoardTable bit_board_table;
+#else
+constexpr BitBoardTable bit_board_table = get_bit_board_table();
+#endif
+
+BitBoard check_simple_piece_move(SearchPosition *state, Square square, GameSideEnum side, const SimplePieceTable *simple_piece_table)
+{
+    BitBoard move = simple_piece_table->move[square] & ~state->occupancy_side[side];
+    return move;
+}
+
+BitBoard check_knight_move(SearchPosition *state, Square square, GameSideEnum side)
+{
+    BitBoard move = check_simple_piece_move(state, square, side, &bit_board_table.knight_table);
+    return move;
+}
+
+BitBoard check_king_move(SearchPosition *state, Square square, GameSideEnum side)
+{
+    BitBoard move = check_simple_piece_move(state, square, side, &bit_board_table.king_table);
+    return move;
+}
+
+BitBoard get_magic_sliding_piece_attack(const SlidingPieceTable *sliding_piece_table, Square square, BitBoard occupancy)
+{
+    const SlidingPieceTableSquare *table_square = &sliding_piece_table->board[square];
+    BitBoard blocker_mask = table_square->blocker_mask;
+    BitBoard blocker = blocker_mask & occupancy;
+    UInt64 hash = (blocker * table_square->magic) >> table_square->shift;
+    BitBoard attack = sliding_piece_table->move[table_square->offset + hash];
+    return attack;
+}
+
+#if defined(__BMI2__)
+BitBoard get_pext_sliding_piece_attack(const SlidingPieceTable *sliding_piece_table, Square square, BitBoard occupancy)
+{
+    const SlidingPieceTableSquare *table_square = &sliding_piece_table->board[square];
+    BitBoard attack = sliding_piece_table->pext_move[table_square->pext_offset + _pext_u64(occupancy, table_square->blocker_mask)];
+    return attack;
+}
+#endif
+
+// NOTE: Sliding attacks use PEXT when the compiler targets BMI2 (-mbmi2), otherwise magic multiply and shift. PEXT is
+// microcoded and slow on AMD before Zen 3, so only build it for CPUs where it is fast.
+BitBoard get_sliding_piece_attack(const SlidingPieceTable *sliding_piece_table, Square square, BitBoard occupancy)
+{
+#if defined(__BMI2__)
+    BitBoard attack = get_pext_sliding_piece_attack(sliding_piece_table, square, occupancy);
+#else
+    BitBoard attack = get_magic_sliding_piece_attack(sliding_piece_table, square, occupancy);
+#endif
+    return attack;
+}
+
+BitBoard check_sliding_piece_move(SearchPosition *state, Square square, GameSideEnum side, const SlidingPieceTable *sliding_piece_table)
+{
+    BitBoard occupancy = get_occupancy(state);
+    BitBoard move = get_sliding_piece_attack(sliding_piece_table, square, occupancy) & ~state->occupancy_side[side];
+    return move;
+}
+
+BitBoard check_bishop_move(SearchPosition *state, Square square, GameSideEnum side)
+{
+    BitBoard move = check_sliding_piece_move(state, square, side, &bit_board_table.bishop_table);
+    return move;
+}
+
+BitBoard check_rook_move(SearchPosition *state, Square square, GameSideEnum side)
+{
+    BitBoard move = check_sliding_piece_move(state, square, side, &bit_board_table.rook_table);
+    return move;
+}
+
+BitBoard check_queen_move(SearchPosition *state, Square square, GameSideEnum side)
+{
+    BitBoard move = check_sliding_piece_move(state, square, side, &bit_board_table.bishop_table);
+    move |= check_sliding_piece_move(state, square, side, &bit_board_table.rook_table);
+    return move;
+}
+
+// NOTE: Shifting towards column h must clear column a and shifting towards column a must clear column h
+#define LEFT_SIDE_MASK (0xfefefefefefefefellu)
+#define RIGHT_SIDE_MASK (0x7f7f7f7f7f7f7f7fllu)
+
+template <GameSideEnum Side>
+BitBoard left(BitBoard pawn_bit)
+{
+    BitBoard result = Side == GameSide::white ? ((pawn_bit << 1) & LEFT_SIDE_MASK) : ((pawn_bit >> 1) & RIGHT_SIDE_MASK);
+    return result;
+}
+
+template <GameSideEnum Side>
+BitBoard right(BitBoard pawn_bit)
+{
+    BitBoard result = left<oppose(Side)>(pawn_bit);
+    return result;
+}
+
+template <GameSideEnum Side>
+BitBoard up(BitBoard pawn_bit)
+{
+    BitBoard result = Side == GameSide::white ? (pawn_bit << 8) : (pawn_bit >> 8);
+    return result;
+}
+
+template <GameSideEnum Side>
+BitBoard down(BitBoard pawn_bit)
+{
+    BitBoard result = up<oppose(Side)>(pawn_bit);
+    return result;
+}
+
+template <GameSideEnum Side>
+BitBoard up_left(BitBoard pawn_bit)
+{
+    BitBoard result = Side == GameSide::white ? ((pawn_bit << 7) & RIGHT_SIDE_MASK) : ((pawn_bit >> 9) & RIGHT_SIDE_MASK);
+    return result;
+}
+
+template <GameSideEnum Side>
+BitBoard down_right(BitBoard pawn_bit)
+{
+    BitBoard result = up_left<oppose(Side)>(pawn_bit);
+    return result;
+}
+
+template <GameSideEnum Side>
+BitBoard up_right(BitBoard pawn_bit)
+{
+    BitBoard result = Side == GameSide::white ? ((pawn_bit << 9) & LEFT_SIDE_MASK) : ((pawn_bit >> 7) & LEFT_SIDE_MASK);
+    return result;
+}
+
+template <GameSideEnum Side>
+BitBoard down_left(BitBoard pawn_bit)
+{
+    BitBoard result = up_right<oppose(Side)>(pawn_bit);
+    return result;
+}
+
+BitBoard get_row_mask(Square row)
+{
+    ASSERT(row >= 0 && row < 8);
+    BitBoard result = 0xffllu << (8 * row);
+    return result;
+}
+
+BitBoard get_column_mask(Square column)
+{
+    ASSERT(column >= 0 && column < 8);
+    BitBoard result = 0x0101010101010101llu << column;
+    return result;
+}
+
+template <GameSideEnum Side>
+BitBoard get_forward_mask(Square row)
+{
+    ASSERT(row >= 0 && row < 8);
+    BitBoard result = (BitBoard(-1)) << (8 * row);
+    result = Side == GameSide::white ? result << 8 : ~result;
+    return result;
+}
+
+template <GameSideEnum Side>
+BitBoard check_pawn_move(SearchPosition *state, Square square)
+{
+    BitBoard move = 0;
+    BitBoard occupancy = get_occupancy(state);
+    BitBoard square_bit = bit_square(square);
+    BitBoard start_squares = Side == GameSide::white ? ~(((UInt64)-1) << 8) << 8 : ~(((UInt64)-1) >> 8) >> 8;
+    Bool is_start = square_bit & start_squares;
+
+    square_bit = up<Side>(square_bit);
+    move |= square_bit & ~occupancy;
+
+    if (is_start && move)
+    {
+        square_bit = up<Side>(square_bit);
+        move |= square_bit & ~occupancy;
+    }
+    return move;
+}
+
+template <GameSideEnum Side>
+BitBoard check_pawn_capture(SearchPosition *state, Square square)
+{
+    BitBoard square_bit = bit_square(square);
+    BitBoard oppose_occupancy = state->occupancy_side[oppose(Side)];
+    if (state->en_passant != NO_SQUARE)
+    {
+        oppose_occupancy |= bit_square(state->en_passant);
+    }
+
+    BitBoard move = 0;
+    move |= up_left<Side>(square_bit) & oppose_occupancy;
+    move |= up_right<Side>(square_bit) & oppose_occupancy;
+    return move;
+}
+
+template <GameSideEnum Side>
+BitBoard check_castling_move(SearchPosition *state)
+{
+    BitBoard occupancy = get_occupancy(state);
+    BitBoard move = 0;
+    if (state->castling & get_castling_mask(Side, GameCastlingMask::queen_side))
+    {
+        BitBoard blocker_mask = Side == GameSide::white ? 0xellu : 0xellu << 56;
         if (!(blocker_mask & occupancy))
         {
-            BitBoard move_to = side == GameSide::white ? 0x40llu : 0x40llu << 56;
+            BitBoard move_to = Side == GameSide::white ? 0x4llu : 0x4llu << 56;
+            move |= move_to;
+        }
+    }
+
+    if (state->castling & get_castling_mask(Side, GameCastlingMask::king_side))
+    {
+        BitBoard blocker_mask = Side == GameSide::white ? 0x60llu : 0x60llu << 56;
+        if (!(blocker_mask & occupancy))
+        {
+            BitBoard move_to = Side == GameSide::white ? 0x40llu : 0x40llu << 56;
             move |= move_to;
         }
     }
     return move;
 }
 
-BitBoard check_game_move(GameState *state, Square square)
+template <GameSideEnum Side>
+BitBoard check_piece_move(SearchPosition *state, Square square, GamePieceTypeEnum piece_type)
 {
-    ASSERT(square >= 0 && square < 64);
-    GamePiece piece = state->board[square];
-    ASSERT(!is_empty(piece));
-
-    GameSideEnum side = get_side(piece);
-    GamePieceTypeEnum piece_type = get_piece_type(piece);
     switch (piece_type)
     {
     case GamePieceType::pawn:
     {
-        BitBoard move = check_pawn_move(state, square, side);
-        move |= check_pawn_capture(state, square, side);
+        BitBoard move = check_pawn_move<Side>(state, square);
+        move |= check_pawn_capture<Side>(state, square);
         return move;
     }
     break;
 
     case GamePieceType::knight:
     {
-        BitBoard move = check_knight_move(state, square, side);
+        BitBoard move = check_knight_move(state, square, Side);
         return move;
     }
     break;
 
     case GamePieceType::bishop:
     {
-        BitBoard move = check_bishop_move(state, square, side);
+        BitBoard move = check_bishop_move(state, square, Side);
         return move;
     }
     break;
 
     case GamePieceType::rook:
     {
-        BitBoard move = check_rook_move(state, square, side);
+        BitBoard move = check_rook_move(state, square, Side);
         return move;
     }
     break;
 
     case GamePieceType::queen:
     {
-        BitBoard move = check_queen_move(state, square, side);
+        BitBoard move = check_queen_move(state, square, Side);
         return move;
     }
     break;
 
     case GamePieceType::king:
     {
-        BitBoard move = check_king_move(state, square, side);
-        BitBoard castling_move = check_castling_move(state, side);
+        BitBoard move = check_king_move(state, square, Side);
+        BitBoard castling_move = check_castling_move<Side>(state);
         move |= castling_move;
         return move;
     }
@@ -730,38 +1715,74 @@ BitBoard check_game_move(GameState *state, Square square)
     }
 }
 
-BitBoard check_attack_by(GameState *state, Square square, GameSideEnum side)
+BitBoard check_piece_move(SearchPosition *state, Square square, GameSideEnum side, GamePieceTypeEnum piece_type)
+{
+    BitBoard move = side == GameSide::white ? check_piece_move<GameSide::white>(state, square, piece_type) : check_piece_move<GameSide::black>(state, square, piece_type);
+    return move;
+}
+
+BitBoard check_game_move(SearchPosition *state, Square square)
+{
+    ASSERT(square >= 0 && square < 64);
+    GamePiece piece = get_square_piece(state, square);
+    ASSERT(!is_empty(piece));
+    BitBoard move = check_piece_move(state, square, get_side(piece), get_piece_type(piece));
+    return move;
+}
+
+// NOTE: Pieces of the oppose side of `side` attacking the square, with sliding pieces blocked by the given occupancy
+template <GameSideEnum Side>
+BitBoard check_attack_by(SearchPosition *state, Square square, BitBoard occupancy)
+{
+    const BitBoardTable *table = &bit_board_table;
+    BitBoard oppose_occupancy = state->occupancy_side[oppose(Side)];
+    BitBoard square_bit = bit_square(square);
+    BitBoard attacks = 0;
+    BitBoard pawn_attack = up_left<Side>(square_bit) | up_right<Side>(square_bit);
+    attacks |= pawn_attack & state->occupancy_piece_type[GamePieceType::pawn];
+    BitBoard knight_attack = table->knight_table.move[square];
+    attacks |= knight_attack & state->occupancy_piece_type[GamePieceType::knight];
+    BitBoard bishop_attack = get_sliding_piece_attack(&table->bishop_table, square, occupancy);
+    attacks |= bishop_attack & (state->occupancy_piece_type[GamePieceType::bishop] | state->occupancy_piece_type[GamePieceType::queen]);
+    BitBoard rook_attack = get_sliding_piece_attack(&table->rook_table, square, occupancy);
+    attacks |= rook_attack & (state->occupancy_piece_type[GamePieceType::rook] | state->occupancy_piece_type[GamePieceType::queen]);
+    BitBoard king_attack = table->king_table.move[square];
+    attacks |= king_attack & state->occupancy_piece_type[GamePieceType::king];
+    attacks &= oppose_occupancy;
+    return attacks;
+}
+
+template <GameSideEnum Side>
+BitBoard check_attack_by(SearchPosition *state, Square square)
+{
+    BitBoard attacks = check_attack_by<Side>(state, square, get_occupancy(state));
+    return attacks;
+}
+
+BitBoard check_attack_by(SearchPosition *state, Square square, GameSideEnum side, BitBoard occupancy)
+{
+    BitBoard attacks = side == GameSide::white ? check_attack_by<GameSide::white>(state, square, occupancy) : check_attack_by<GameSide::black>(state, square, occupancy);
+    return attacks;
+}
+
+BitBoard check_attack_by(SearchPosition *state, Square square, GameSideEnum side)
 {
-    BitBoard attacks = 0;
-    BitBoard pawn_attack = check_pawn_capture(state, square, side);
-    attacks |= pawn_attack & state->occupancy_piece_type[GamePieceType::pawn];
-    BitBoard knight_attack = check_simple_piece_move(state, square, side, &state->bit_board_table->knight_table);
-    attacks |= knight_attack & state->occupancy_piece_type[GamePieceType::knight];
-    BitBoard bishop_attack = check_sliding_piece_move(state, square, side, &state->bit_board_table->bishop_table);
-    attacks |= bishop_attack & state->occupancy_piece_type[GamePieceType::bishop];
-    BitBoard rook_attack = check_sliding_piece_move(state, square, side, &state->bit_board_table->rook_table);
-    attacks |= rook_attack & state->occupancy_piece_type[GamePieceType::rook];
-    BitBoard queen_attack = bishop_attack | rook_attack;
-    attacks |= queen_attack & state->occupancy_piece_type[GamePieceType::queen];
-    BitBoard king_attack = check_simple_piece_move(state, square, side, &state->bit_board_table->king_table);
-    attacks |= king_attack & state->occupancy_piece_type[GamePieceType::king];
+    BitBoard attacks = check_attack_by(state, square, side, get_occupancy(state));
     return attacks;
 }
 
 // NOTE: Get all information for game move except for promotion index information
-GameMove get_game_move(GameState *state, Square square_from, Square square_to)
+GameMove get_game_move(SearchPosition *state, Square square_from, Square square_to, GamePieceTypeEnum piece_type)
 {
     GameMove move = 0;
     move |= (GameMove)square_from;
     move |= (GameMove)square_to << 6;
     move |= (GameMove)state->castling << 16;
     move |= (GameMove)state->en_passant << 20;
-    GamePiece captured_piece = state->board[square_to];
+    GamePiece captured_piece = get_occupancy(state) & bit_square(square_to) ? get_square_piece(state, square_to) : NO_GAME_PIECE;
     move |= (GameMove)captured_piece << 27;
     move |= (GameMove)state->current_side << 31;
 
-    GamePiece piece = state->board[square_from];
-    GamePieceTypeEnum piece_type = get_piece_type(piece);
     if (piece_type == GamePieceType::king)
     {
         if (ABS(square_to - square_from) == 2)
@@ -777,6 +1798,10 @@ GameMove get_game_move(GameState *state, Square square_from, Square square_to)
         if (column_from != column_to && is_empty(captured_piece))
         {
             move |= GameMoveType::en_passant << 12;
+            // NOTE: En passant captures the pawn beside the square from, not the piece at square to
+            Square en_passant_square = get_square(get_row(square_from), column_to);
+            move &= ~((GameMove)0xf << 27);
+            move |= (GameMove)get_square_piece(state, en_passant_square) << 27;
         }
         else if (bit_square(square_to) & final_row_mask)
         {
@@ -786,6 +1811,13 @@ GameMove get_game_move(GameState *state, Square square_from, Square square_to)
     return move;
 }
 
+GameMove get_game_move(SearchPosition *state, Square square_from, Square square_to)
+{
+    GamePieceTypeEnum piece_type = get_piece_type(get_square_piece(state, square_from));
+    GameMove move = get_game_move(state, square_from, square_to, piece_type);
+    return move;
+}
+
 GameMove add_promotion_index(GameMove move, Int promotion_index)
 {
     ASSERT(get_move_type(move) == GameMoveType::promotion);
@@ -870,8 +1902,90 @@ Void push_game_history(GameState *state, GameMove move)
     state->history_count = MIN(MAX_HISTORY_COUNT, state->history_count + 1);
 }
 
+Void push_position_history(GameState *state)
+{
+    PositionHistory *position_history = &state->position_history[state->position_history_count & POSITION_HISTORY_MASK];
+    position_history->zobrist = state->zobrist;
+    position_history->halfmove_clock = state->halfmove_clock;
+    state->position_history_count++;
+}
+
+Void pop_position_history(GameState *state)
+{
+    ASSERT(state->position_history_count > 0);
+    state->position_history_count--;
+    PositionHistory *position_history = &state->position_history[state->position_history_count & POSITION_HISTORY_MASK];
+    state->halfmove_clock = position_history->halfmove_clock;
+}
+
+#if defined(NNUE_EVAL)
+// NOTE: Shares the index of the position history, only king moves write to it
+Void push_nnue_accumulator_history(GameState *state, GamePiece piece)
+{
+    if (nnue_network && get_piece_type(piece) == GamePieceType::king)
+    {
+        GameSideEnum side = get_side(piece);
+        NnueAccumulatorHistory *accumulator_history = &state->nnue_accumulator_history[state->position_history_count & POSITION_HISTORY_MASK];
+        accumulator_history->zobrist = state->zobrist;
+        memcpy(accumulator_history->value, state->nnue_accumulator.value[side], sizeof(accumulator_history->value));
+        accumulator_history->valid = state->nnue_accumulator.valid[side];
+    }
+}
+
+Void pop_nnue_accumulator_history(GameState *state, GamePiece piece)
+{
+    if (nnue_network && get_piece_type(piece) == GamePieceType::king)
+    {
+        GameSideEnum side = get_side(piece);
+        NnueAccumulatorHistory *accumulator_history = &state->nnue_accumulator_history[state->position_history_count & POSITION_HISTORY_MASK];
+        if (accumulator_history->zobrist == state->zobrist)
+        {
+            memcpy(state->nnue_accumulator.value[side], accumulator_history->value, sizeof(accumulator_history->value));
+            state->nnue_accumulator.valid[side] = accumulator_history->valid;
+        }
+    }
+}
+#endif
+
+GameCastling get_castling_after_move(GameCastling castling, Square square_from, Square square_to)
+{
+    Square king_square[2] = {4, 4 + 56};
+    Square rook_square_queen_side[2] = {0, 0 + 56};
+    Square rook_square_king_side[2] = {7, 7 + 56};
+    for (GameSideEnum side = 0; side < GameSide::count; side++)
+    {
+        if (square_from == king_square[side] || square_to == king_square[side])
+        {
+            castling &= ~get_castling_mask(side, GameCastlingMask::both_side);
+        }
+        if (square_from == rook_square_queen_side[side] || square_to == rook_square_queen_side[side])
+        {
+            castling &= ~get_castling_mask(side, GameCastlingMask::queen_side);
+        }
+        if (square_from == rook_square_king_side[side] || square_to == rook_square_king_side[side])
+        {
+            castling &= ~get_castling_mask(side, GameCastlingMask::king_side);
+        }
+    }
+    return castling;
+}
+
+Square get_en_passant_after_move(GamePieceTypeEnum piece_type, Square square_from, Square square_to)
+{
+    if (piece_type == GamePieceType::pawn && ABS(square_to - square_from) == 16)
+    {
+        return (square_from + square_to) / 2;
+    }
+    return NO_SQUARE;
+}
+
 Void record_game_move(GameState *state, GameMove move)
 {
+#if defined(NNUE_EVAL)
+    push_nnue_accumulator_history(state, state->board[get_from(move)]);
+#endif
+    push_position_history(state);
+
     Square capture_square = get_capture_square(move);
     if (capture_square != NO_SQUARE)
     {
@@ -906,39 +2020,18 @@ Void record_game_move(GameState *state, GameMove move)
         add_game_piece(state, square_to, promotion_piece);
     }
 
-    GameCastling castling = state->castling;
-    Square king_square[2] = {4, 4 + 56};
-    Square rook_square_queen_side[2] = {0, 0 + 56};
-    Square rook_square_king_side[2] = {7, 7 + 56};
-    for (GameSideEnum side = 0; side < GameSide::count; side++)
-    {
-        if (square_from == king_square[side] || square_to == king_square[side])
-        {
-            castling &= ~get_castling_mask(side, GameCastlingMask::both_side);
-        }
-        if (square_from == rook_square_queen_side[side] || square_to == rook_square_queen_side[side])
-        {
-            castling &= ~get_castling_mask(side, GameCastlingMask::queen_side);
-        }
-        if (square_from == rook_square_king_side[side] || square_to == rook_square_king_side[side])
-        {
-            castling &= ~get_castling_mask(side, GameCastlingMask::king_side);
-        }
-    }
-    update_castling(state, castling);
+    update_castling(state, get_castling_after_move(state->castling, square_from, square_to));
+    update_en_passant(state, get_en_passant_after_move(piece_type, square_from, square_to));
+    update_current_side(state, oppose(state->current_side));
 
-    Square en_passant = state->en_passant;
-    if (piece_type == GamePieceType::pawn && ABS(square_to - square_from) == 16)
+    if (piece_type == GamePieceType::pawn || capture_square != NO_SQUARE)
     {
-        en_passant = (square_from + square_to) / 2;
+        state->halfmove_clock = 0;
     }
     else
     {
-        en_passant = NO_SQUARE;
+        state->halfmove_clock++;
     }
-    update_en_passant(state, en_passant);
-
-    update_current_side(state, oppose(state->current_side));
 }
 
 Void record_game_move_with_history(GameState *state, GameMove move)
@@ -947,6 +2040,25 @@ Void record_game_move_with_history(GameState *state, GameMove move)
     push_game_history(state, move);
 }
 
+// NOTE: Pass the turn, only used by search. Returns the en passant square to restore on rollback. Repetitions are not
+// looked for across a null move.
+Square record_null_move(GameState *state)
+{
+    push_position_history(state);
+    state->halfmove_clock = 0;
+    Square en_passant = state->en_passant;
+    update_en_passant(state, NO_SQUARE);
+    update_current_side(state, oppose(state->current_side));
+    return en_passant;
+}
+
+Void rollback_null_move(GameState *state, Square en_passant)
+{
+    update_current_side(state, oppose(state->current_side));
+    update_en_passant(state, en_passant);
+    pop_position_history(state);
+}
+
 Void rollback_game_move(GameState *state, GameMove move)
 {
     Square square_from = get_from(move);
@@ -985,6 +2097,83 @@ Void rollback_game_move(GameState *state, GameMove move)
     update_en_passant(state, get_en_passant(move));
 
     update_current_side(state, oppose(state->current_side));
+    pop_position_history(state);
+#if defined(NNUE_EVAL)
+    pop_nnue_accumulator_history(state, piece);
+#endif
+}
+
+Void toggle_search_piece(SearchPosition *position, Square square, GameSideEnum side, GamePieceTypeEnum piece_type)
+{
+    BitBoard square_bit = bit_square(square);
+    position->occupancy_side[side] ^= square_bit;
+    position->occupancy_piece_type[piece_type] ^= square_bit;
+    position->zobrist ^= zobrist_square[side][piece_type][square];
+}
+
+// NOTE: Copy-make, the move is applied to a copy of the position so there is nothing to roll back. Only the hot part
+// of the game state is copied, the board array, eval accumulators and position history are left behind
+Void apply_move(SearchPosition *position, GameMove move, SearchPosition *result)
+{
+    *result = *position;
+
+    Square square_from = get_from(move);
+    Square square_to = get_to(move);
+    GameSideEnum side = position->current_side;
+    GamePieceTypeEnum piece_type = get_piece_type(get_square_piece(position, square_from));
+
+    Square capture_square = get_capture_square(move);
+    if (capture_square != NO_SQUARE)
+    {
+        ASSERT(get_square_piece(position, capture_square) == get_captured_piece(move));
+        toggle_search_piece(result, capture_square, oppose(side), get_piece_type(get_captured_piece(move)));
+    }
+
+    GameMoveTypeEnum move_type = get_move_type(move);
+    toggle_search_piece(result, square_from, side, piece_type);
+    if (move_type == GameMoveType::promotion)
+    {
+        ASSERT(piece_type == GamePieceType::pawn);
+        toggle_search_piece(result, square_to, side, promotion_list[get_promotion_index(move)]);
+    }
+    else
+    {
+        toggle_search_piece(result, square_to, side, piece_type);
+    }
+
+    if (move_type == GameMoveType::castling)
+    {
+        GameMove rook_move = get_castling_rook_move(move);
+        toggle_search_piece(result, get_from(rook_move), side, GamePieceType::rook);
+        toggle_search_piece(result, get_to(rook_move), side, GamePieceType::rook);
+    }
+
+    update_castling(result, get_castling_after_move(position->castling, square_from, square_to));
+    update_en_passant(result, get_en_passant_after_move(piece_type, square_from, square_to));
+    update_current_side(result, oppose(side));
+}
+
+// NOTE: Earlier occurrences of the current position, only positions with the same side to move since the last
+// irreversible move can match
+Int get_repetition_count(GameState *state)
+{
+    Int count = 0;
+    Int back_count = MIN(state->halfmove_clock, MIN(state->position_history_count, MAX_POSITION_HISTORY_COUNT));
+    for (Int back = 2; back <= back_count; back += 2)
+    {
+        PositionHistory *position_history = &state->position_history[(state->position_history_count - back) & POSITION_HISTORY_MASK];
+        if (position_history->zobrist == state->zobrist)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+Bool is_fifty_move_draw(GameState *state)
+{
+    Bool result = state->halfmove_clock >= 100;
+    return result;
 }
 
 Bool undo(GameState *state, GameMove *move)
@@ -1021,7 +2210,7 @@ Bool redo(GameState *state, GameMove *move)
     }
 }
 
-Bool in_check(GameState *state, GameSideEnum side)
+Bool in_check(SearchPosition *state, GameSideEnum side)
 {
     Square king_square = first_set(get_occupancy(state, side, GamePieceType::king));
     return check_attack_by(state, king_square, side);
@@ -1037,8 +2226,9 @@ Bool is_move_legal(GameState *state, GameMove move)
     GameSideEnum side = get_side(piece);
     if (move_type == GameMoveType::castling)
     {
+        // NOTE: King can't castle out of, through or into check
         Int step = square_to > square_from ? 1 : -1;
-        for (Square square = square_from; square <= square_to; square += step)
+        for (Square square = square_from; square != square_to + step; square += step)
         {
             BitBoard attack_by = check_attack_by(state, square, side);
             if (attack_by)
@@ -1057,39 +2247,334 @@ Bool is_move_legal(GameState *state, GameMove move)
     }
 }
 
-Void generate_all_moves(GameState *state, Buffer<GameMove> *moves)
+Void add_generated_moves(SearchPosition *state, Square square_from, GamePieceTypeEnum piece_type, BitBoard all_moves, Buffer<GameMove> *moves)
+{
+    while (all_moves)
+    {
+        Square square_to = first_set(all_moves);
+        all_moves -= bit_square(square_to);
+
+        GameMove move = get_game_move(state, square_from, square_to, piece_type);
+        if (get_move_type(move) == GameMoveType::promotion)
+        {
+            for (Int promotion_index = 0; promotion_index < promotion_list.count; promotion_index++)
+            {
+                moves->data[moves->count++] = add_promotion_index(move, promotion_index);
+            }
+        }
+        else
+        {
+            moves->data[moves->count++] = move;
+        }
+    }
+}
+
+// NOTE: Friend pieces that are the only blocker between the king and an oppose sliding piece
+template <GameSideEnum Side>
+BitBoard get_pinned(SearchPosition *state, Square king_square)
+{
+    const BitBoardTable *table = &bit_board_table;
+    constexpr GameSideEnum oppose_side = oppose(Side);
+    BitBoard occupancy = get_occupancy(state);
+    BitBoard oppose_occupancy = state->occupancy_side[oppose_side];
+    BitBoard queen_occupancy = state->occupancy_piece_type[GamePieceType::queen];
+    BitBoard snipers = (get_sliding_piece_attack(&table->rook_table, king_square, oppose_occupancy) & (state->occupancy_piece_type[GamePieceType::rook] | queen_occupancy)) |
+                       (get_sliding_piece_attack(&table->bishop_table, king_square, oppose_occupancy) & (state->occupancy_piece_type[GamePieceType::bishop] | queen_occupancy));
+    snipers &= oppose_occupancy;
+
+    BitBoard pinned = 0;
+    while (snipers)
+    {
+        Square sniper_square = first_set(snipers);
+        snipers -= bit_square(sniper_square);
+
+        BitBoard blocker = table->between[king_square][sniper_square] & occupancy;
+        if (blocker && !(blocker & (blocker - 1)))
+        {
+            pinned |= blocker & state->occupancy_side[Side];
+        }
+    }
+    return pinned;
+}
+
+// NOTE: Pawn moves in target squares that all come from the square `shift` behind
+Void add_pawn_moves(BitBoard targets, Int shift, GameMove move_base, Buffer<GameMove> *moves)
+{
+    while (targets)
+    {
+        Square square_to = first_set(targets);
+        targets -= bit_square(square_to);
+        moves->data[moves->count++] = move_base | (GameMove)(square_to - shift) | (GameMove)square_to << 6;
+    }
+}
+
+Void add_pawn_promotion_moves(BitBoard targets, Int shift, GameMove move_base, Buffer<GameMove> *moves)
+{
+    while (targets)
+    {
+        Square square_to = first_set(targets);
+        targets -= bit_square(square_to);
+        GameMove move = move_base | (GameMove)GameMoveType::promotion << 12 | (GameMove)(square_to - shift) | (GameMove)square_to << 6;
+        for (Int promotion_index = 0; promotion_index < promotion_list.count; promotion_index++)
+        {
+            moves->data[moves->count++] = add_promotion_index(move, promotion_index);
+        }
+    }
+}
+
+// NOTE: Pushes and captures of all the given pawns at once by shifting the whole pawn bit board. Pinned pawns and en
+// passant are left to the caller. Captures are split by captured piece type so no board lookup is needed per move.
+template <GameSideEnum Side>
+Void generate_pawn_moves(SearchPosition *state, Buffer<GameMove> *moves, BitBoard pawns, BitBoard target_mask, Bool capture_only)
+{
+    constexpr GameSideEnum oppose_side = oppose(Side);
+    constexpr Int up_shift = Side == GameSide::white ? 8 : -8;
+    constexpr Int up_left_shift = Side == GameSide::white ? 7 : -9;
+    constexpr Int up_right_shift = Side == GameSide::white ? 9 : -7;
+    BitBoard promotion_row_mask = get_row_mask(get_row_rel<Side>(Sq::a8));
+    BitBoard double_push_row_mask = get_row_mask(get_row_rel<Side>(Sq::a3));
+    BitBoard empty = ~get_occupancy(state);
+
+    GameMove move_base = 0;
+    move_base |= (GameMove)state->castling << 16;
+    move_base |= (GameMove)state->en_passant << 20;
+    move_base |= (GameMove)Side << 31;
+
+    BitBoard single_push = up<Side>(pawns) & empty;
+    BitBoard double_push = up<Side>(single_push & double_push_row_mask) & empty & target_mask;
+    single_push &= target_mask;
+    GameMove push_move_base = move_base | (GameMove)NO_GAME_PIECE << 27;
+    add_pawn_promotion_moves(single_push & promotion_row_mask, up_shift, push_move_base, moves);
+    if (!capture_only)
+    {
+        add_pawn_moves(single_push & ~promotion_row_mask, up_shift, push_move_base, moves);
+        add_pawn_moves(double_push, 2 * up_shift, push_move_base, moves);
+    }
+
+    BitBoard left_attack = up_left<Side>(pawns) & target_mask;
+    BitBoard right_attack = up_right<Side>(pawns) & target_mask;
+    for (GamePieceTypeEnum piece_type = GamePieceType::pawn; piece_type < GamePieceType::king; piece_type++)
+    {
+        BitBoard victims = get_occupancy(state, oppose_side, piece_type);
+        GameMove capture_move_base = move_base | (GameMove)get_game_piece(oppose_side, piece_type) << 27;
+        BitBoard left_capture = left_attack & victims;
+        BitBoard right_capture = right_attack & victims;
+        add_pawn_promotion_moves(left_capture & promotion_row_mask, up_left_shift, capture_move_base, moves);
+        add_pawn_promotion_moves(right_capture & promotion_row_mask, up_right_shift, capture_move_base, moves);
+        add_pawn_moves(left_capture & ~promotion_row_mask, up_left_shift, capture_move_base, moves);
+        add_pawn_moves(right_capture & ~promotion_row_mask, up_right_shift, capture_move_base, moves);
+    }
+}
+
+// NOTE: Generate legal moves directly. Checkers and pinned pieces are computed once, non king moves are restricted to
+// the check evasion mask and the pin line, king moves are tested against attacks with the king lifted off the board.
+// With capture only, quiet moves except pawn pushes to promotion are dropped.
+template <GameSideEnum Side>
+Void generate_moves(SearchPosition *state, Buffer<GameMove> *moves, Bool capture_only)
 {
-    BitBoard all_pieces = state->occupancy_side[state->current_side];
+    const BitBoardTable *table = &bit_board_table;
+    BitBoard occupancy = get_occupancy(state);
+    BitBoard friend_occupancy = state->occupancy_side[Side];
+    BitBoard king_bit = get_occupancy(state, Side, GamePieceType::king);
+    Square king_square = first_set(king_bit);
+
+    BitBoard checkers = check_attack_by<Side>(state, king_square);
+    BitBoard pinned = get_pinned<Side>(state, king_square);
+
+    BitBoard capture_mask = capture_only ? state->occupancy_side[oppose(Side)] : ~0ull;
+    BitBoard promotion_mask = capture_only ? get_row_mask(Side == GameSide::white ? 7 : 0) : 0;
+
+    BitBoard king_moves = table->king_table.move[king_square] & ~friend_occupancy & capture_mask;
+    BitBoard king_occupancy = occupancy ^ king_bit;
+    BitBoard king_legal_moves = 0;
+    while (king_moves)
+    {
+        Square square_to = first_set(king_moves);
+        king_moves -= bit_square(square_to);
+        if (!check_attack_by<Side>(state, square_to, king_occupancy))
+        {
+            king_legal_moves |= bit_square(square_to);
+        }
+    }
+
+    // NOTE: Only king can move in double check
+    if (checkers & (checkers - 1))
+    {
+        add_generated_moves(state, king_square, GamePieceType::king, king_legal_moves, moves);
+        return;
+    }
+
+    BitBoard target_mask = ~friend_occupancy;
+    if (checkers)
+    {
+        Square checker_square = first_set(checkers);
+        target_mask &= table->between[king_square][checker_square] | checkers;
+    }
+    else if (!capture_only)
+    {
+        BitBoard castling_moves = check_castling_move<Side>(state);
+        while (castling_moves)
+        {
+            Square square_to = first_set(castling_moves);
+            castling_moves -= bit_square(square_to);
+            Square square_pass = (king_square + square_to) / 2;
+            if (!check_attack_by<Side>(state, square_pass) && !check_attack_by<Side>(state, square_to))
+            {
+                king_legal_moves |= bit_square(square_to);
+            }
+        }
+    }
+    add_generated_moves(state, king_square, GamePieceType::king, king_legal_moves, moves);
+
+    BitBoard pawns = get_occupancy(state, Side, GamePieceType::pawn);
+    generate_pawn_moves<Side>(state, moves, pawns & ~pinned, target_mask, capture_only);
+
+    BitBoard en_passant_bit = 0;
+    if (state->en_passant != NO_SQUARE)
+    {
+        // NOTE: En passant removes two pieces from one row, test the resulting position directly. This also covers
+        // pinned pawns and the check evasion mask.
+        en_passant_bit = bit_square(state->en_passant);
+        BitBoard en_passant_pawn_bit = down<Side>(en_passant_bit);
+        BitBoard en_passant_pawns = (down_left<Side>(en_passant_bit) | down_right<Side>(en_passant_bit)) & pawns;
+        while (en_passant_pawns)
+        {
+            Square square_from = first_set(en_passant_pawns);
+            en_passant_pawns -= bit_square(square_from);
+            BitBoard en_passant_occupancy = (occupancy ^ bit_square(square_from) ^ en_passant_pawn_bit) | en_passant_bit;
+            BitBoard attack_by = check_attack_by<Side>(state, king_square, en_passant_occupancy) & ~en_passant_pawn_bit;
+            if (!attack_by)
+            {
+                add_generated_moves(state, square_from, GamePieceType::pawn, en_passant_bit, moves);
+            }
+        }
+    }
+
+    BitBoard all_pieces = friend_occupancy & ~king_bit & ~(pawns & ~pinned);
     while (all_pieces)
     {
         Square square_from = first_set(all_pieces);
         all_pieces -= bit_square(square_from);
 
-        BitBoard all_moves = check_game_move(state, square_from);
-        while (all_moves)
+        GamePieceTypeEnum piece_type = get_piece_type(get_square_piece(state, square_from));
+        BitBoard all_moves = check_piece_move<Side>(state, square_from, piece_type);
+        BitBoard pin_mask = pinned & bit_square(square_from) ? table->line[king_square][square_from] : ~0ull;
+        all_moves &= pin_mask & target_mask;
+        if (piece_type == GamePieceType::pawn)
+        {
+            all_moves &= ~en_passant_bit;
+        }
+        if (capture_only)
+        {
+            all_moves &= capture_mask | (piece_type == GamePieceType::pawn ? promotion_mask : 0);
+        }
+        add_generated_moves(state, square_from, piece_type, all_moves, moves);
+    }
+}
+
+// NOTE: Side dispatched once per node, the generator itself has no branches on the side
+Void generate_moves(SearchPosition *state, Buffer<GameMove> *moves, Bool capture_only)
+{
+    if (state->current_side == GameSide::white)
+    {
+        generate_moves<GameSide::white>(state, moves, capture_only);
+    }
+    else
+    {
+        generate_moves<GameSide::black>(state, moves, capture_only);
+    }
+}
+
+Void generate_all_moves(SearchPosition *state, Buffer<GameMove> *moves)
+{
+    generate_moves(state, moves, false);
+}
+
+Void generate_capture_moves(SearchPosition *state, Buffer<GameMove> *moves)
+{
+    generate_moves(state, moves, true);
+}
+
+Int see_values[GamePieceType::count] = {100, 325, 325, 500, 975, 20000};
+
+// NOTE: Attackers of both sides to a square, sliders blocked by the given occupancy and pieces outside it ignored
+BitBoard get_attack_to(SearchPosition *state, Square square, BitBoard occupancy)
+{
+    BitBoard attacks = check_attack_by(state, square, GameSide::white, occupancy) | check_attack_by(state, square, GameSide::black, occupancy);
+    attacks &= occupancy;
+    return attacks;
+}
+
+// NOTE: Static exchange evaluation of the move for the side to move. Both sides recapture on the target square with
+// their least valuable attacker, sliders uncovered behind a capturing piece join in, and each side may stop the exchange
+// when continuing would lose material.
+Int get_see(SearchPosition *state, GameMove move)
+{
+    const BitBoardTable *table = &bit_board_table;
+    Square square_from = get_from(move);
+    Square square_to = get_to(move);
+    BitBoard occupancy = get_occupancy(state);
+    BitBoard bishop_sliders = state->occupancy_piece_type[GamePieceType::bishop] | state->occupancy_piece_type[GamePieceType::queen];
+    BitBoard rook_sliders = state->occupancy_piece_type[GamePieceType::rook] | state->occupancy_piece_type[GamePieceType::queen];
+
+    Int gain[32];
+    Int depth = 0;
+    GamePiece captured_piece = get_captured_piece(move);
+    gain[0] = is_empty(captured_piece) ? 0 : see_values[get_piece_type(captured_piece)];
+    GamePieceTypeEnum piece_type = get_piece_type(get_square_piece(state, square_from));
+    if (get_move_type(move) == GameMoveType::promotion)
+    {
+        GamePieceTypeEnum promotion_piece_type = promotion_list[get_promotion_index(move)];
+        gain[0] += see_values[promotion_piece_type] - see_values[GamePieceType::pawn];
+        piece_type = promotion_piece_type;
+    }
+    else if (get_move_type(move) == GameMoveType::en_passant)
+    {
+        occupancy ^= bit_square(get_capture_square(move));
+    }
+
+    BitBoard from_bit = bit_square(square_from);
+    BitBoard attackers = get_attack_to(state, square_to, occupancy);
+    GameSideEnum side = state->current_side;
+    while (true)
+    {
+        depth++;
+        gain[depth] = see_values[piece_type] - gain[depth - 1];
+
+        occupancy ^= from_bit;
+        attackers &= occupancy;
+        if (piece_type != GamePieceType::knight && piece_type != GamePieceType::rook)
+        {
+            attackers |= get_sliding_piece_attack(&table->bishop_table, square_to, occupancy) & bishop_sliders & occupancy;
+        }
+        if (piece_type == GamePieceType::rook || piece_type == GamePieceType::queen || piece_type == GamePieceType::king)
         {
-            Square square_to = first_set(all_moves);
-            all_moves -= bit_square(square_to);
+            attackers |= get_sliding_piece_attack(&table->rook_table, square_to, occupancy) & rook_sliders & occupancy;
+        }
 
-            GameMove move = get_game_move(state, square_from, square_to);
-            if (is_move_legal(state, move))
+        side = oppose(side);
+        BitBoard side_attackers = attackers & state->occupancy_side[side];
+        if (!side_attackers)
+        {
+            break;
+        }
+        for (piece_type = GamePieceType::pawn; piece_type < GamePieceType::count; piece_type++)
+        {
+            BitBoard piece_attackers = side_attackers & state->occupancy_piece_type[piece_type];
+            if (piece_attackers)
             {
-                GameMoveTypeEnum move_type = get_move_type(move);
-                if (move_type == GameMoveType::promotion)
-                {
-                    for (Int promotion_index = 0; promotion_index < promotion_list.count; promotion_index++)
-                    {
-                        move = add_promotion_index(move, promotion_index);
-                        moves->data[moves->count++] = move;
-                    }
-                }
-                else
-                {
-                    moves->data[moves->count++] = move;
-                }
+                from_bit = piece_attackers & -piece_attackers;
+                break;
             }
         }
     }
+
+    // NOTE: Last gain is the capture of the piece nobody recaptured, it never happens
+    while (--depth)
+    {
+        gain[depth - 1] = -MAX(-gain[depth - 1], gain[depth]);
+    }
+    return gain[0];
 }
 
 namespace GameEnd
@@ -1124,6 +2609,10 @@ GameEndEnum check_game_end(GameState *state)
             return GameEnd::draw;
         }
     }
+    else if (is_fifty_move_draw(state) || get_repetition_count(state) >= 2)
+    {
+        return GameEnd::draw;
+    }
     else
     {
         return GameEnd::none;
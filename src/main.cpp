@@ -856,18 +856,41 @@ Void start_sound(SoundRenderer *sound_renderer, Sound *sound)
 
 int WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR command_line, int show_code)
 {
+    ASSERT(check_cpu_features());
+
     AssetStore asset_store;
     ASSERT(load_asset(&asset_store));
 
     RandomGenerator random_generator;
     random_generator.seed = get_current_timestamp();
     initialize_zobrist_keys(&random_generator);
+    initialize_eval_tables();
 
     GameSideEnum initial_player_side = GameSide::white;
-    GameState game_state = get_initial_game_state(asset_store.bit_board_table, initial_player_side);
+    GameState game_state = get_initial_game_state(initial_player_side);
 
     Searcher searcher;
-    ASSERT(initialize_searcher(&searcher, &game_state));
+    ASSERT(initialize_searcher(&searcher, &game_state, get_processor_count()));
+#if defined(NNUE_EVAL)
+    // NOTE: The network is optional, without a valid asset/nnue.asset the classical eval is used. The weights are copied
+    // out, so the file is not kept mapped.
+    Str nnue_file_contents;
+    if (map_file("asset/nnue.asset", &nnue_file_contents))
+    {
+        NnueNetwork *network = (NnueNetwork *)malloc(sizeof(NnueNetwork));
+        if (network && deserialise_nnue_network(nnue_file_contents, network))
+        {
+            nnue_network = network;
+            searcher.nnue_enabled = true;
+        }
+        else
+        {
+            free(network);
+        }
+        unmap_file(nnue_file_contents);
+    }
+#endif
+    searcher.limit = get_move_time_search_limit(2.0);
     ASSERT(run_thread((ThreadFunc)search, &searcher));
 
     Board board;
@@ -1555,7 +1578,7 @@ int WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR command_line, int
                 {
                     if (state.menu_state.selected_player != game_state.player_side)
                     {
-                        game_state = get_initial_game_state(asset_store.bit_board_table, state.menu_state.selected_player);
+                        game_state = get_initial_game_state(state.menu_state.selected_player);
                         fill_piece_manager_initial_state(&piece_manager, &game_state);
                         camera = get_scene_camera(game_state.player_side);
                         reset_state(&state, game_state.player_side);
@@ -1567,7 +1590,7 @@ int WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR command_line, int
                 }
                 else
                 {
-                    game_state = get_initial_game_state(asset_store.bit_board_table, game_state.player_side);
+                    game_state = get_initial_game_state(game_state.player_side);
                     fill_piece_manager_initial_state(&piece_manager, &game_state);
                     reset_state(&state, game_state.player_side);
                 }
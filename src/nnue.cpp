@@ -0,0 +1,314 @@
+#pragma once
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+// NOTE: Efficiently updatable network with HalfKP features. Each side sees the square of its own king together with the
+// square and kind of every piece except the kings, on the board turned to its own side like the relative squares of the
+// classical eval, so both sides share the weights. The hidden layer of each side lives in an accumulator that
+// add_game_piece and remove_game_piece keep up to date, a clipped ReLU of both accumulators feeds a single output.
+#define NNUE_PIECE_KIND_COUNT (10)
+#define NNUE_FEATURE_COUNT (64 * NNUE_PIECE_KIND_COUNT * 64)
+#define NNUE_HIDDEN_COUNT (256)
+#define NNUE_CLIP (127)
+
+#define NNUE_FILE_MAGIC 0x45554e4e
+#define NNUE_FILE_VERSION 1
+
+struct NnueNetwork
+{
+    Int16 feature_bias[NNUE_HIDDEN_COUNT];
+    Int16 feature_weight[NNUE_FEATURE_COUNT][NNUE_HIDDEN_COUNT];
+    // NOTE: First half weighs the side to move, second half the other side
+    Int16 output_weight[GameSide::count][NNUE_HIDDEN_COUNT];
+    Int32 output_bias;
+    Int32 output_divisor;
+};
+
+// NOTE: A side is invalidated when its king moves, since every feature of that side changes. It is recomputed from
+// scratch on the next eval.
+struct NnueAccumulator
+{
+    Int16 value[GameSide::count][NNUE_HIDDEN_COUNT];
+    Bool valid[GameSide::count];
+};
+
+// NOTE: Side of the accumulator from before a king move of that side, kept so rolling the move back restores it rather
+// than leaving the side to be refreshed. The key guards against the ring having been written over since.
+struct NnueAccumulatorHistory
+{
+    UInt64 zobrist;
+    Int16 value[NNUE_HIDDEN_COUNT];
+    Bool valid;
+};
+
+// NOTE: Accumulators are only kept up to date while a network is loaded
+NnueNetwork *nnue_network;
+
+Int get_nnue_feature(GameSideEnum perspective, Square king_square, GameSideEnum side, GamePieceTypeEnum piece_type, Square square)
+{
+    ASSERT(piece_type != GamePieceType::king);
+    Int kind = (side == perspective ? 0 : GamePieceType::king) + piece_type;
+    Int result = (get_abs_square(king_square, perspective) * NNUE_PIECE_KIND_COUNT + kind) * 64 + get_abs_square(square, perspective);
+    return result;
+}
+
+// NOTE: Kernels use AVX2 or SSE4.1 when the compiler targets them (-mavx2, -msse4.1), otherwise plain loops
+Void add_nnue_weight(Int16 *value, const Int16 *weight)
+{
+#if defined(__AVX2__)
+    for (Int i = 0; i < NNUE_HIDDEN_COUNT; i += 16)
+    {
+        __m256i sum = _mm256_add_epi16(_mm256_loadu_si256((__m256i *)(value + i)), _mm256_loadu_si256((__m256i *)(weight + i)));
+        _mm256_storeu_si256((__m256i *)(value + i), sum);
+    }
+#elif defined(__SSE4_1__)
+    for (Int i = 0; i < NNUE_HIDDEN_COUNT; i += 8)
+    {
+        __m128i sum = _mm_add_epi16(_mm_loadu_si128((__m128i *)(value + i)), _mm_loadu_si128((__m128i *)(weight + i)));
+        _mm_storeu_si128((__m128i *)(value + i), sum);
+    }
+#else
+    for (Int i = 0; i < NNUE_HIDDEN_COUNT; i++)
+    {
+        value[i] += weight[i];
+    }
+#endif
+}
+
+Void subtract_nnue_weight(Int16 *value, const Int16 *weight)
+{
+#if defined(__AVX2__)
+    for (Int i = 0; i < NNUE_HIDDEN_COUNT; i += 16)
+    {
+        __m256i difference = _mm256_sub_epi16(_mm256_loadu_si256((__m256i *)(value + i)), _mm256_loadu_si256((__m256i *)(weight + i)));
+        _mm256_storeu_si256((__m256i *)(value + i), difference);
+    }
+#elif defined(__SSE4_1__)
+    for (Int i = 0; i < NNUE_HIDDEN_COUNT; i += 8)
+    {
+        __m128i difference = _mm_sub_epi16(_mm_loadu_si128((__m128i *)(value + i)), _mm_loadu_si128((__m128i *)(weight + i)));
+        _mm_storeu_si128((__m128i *)(value + i), difference);
+    }
+#else
+    for (Int i = 0; i < NNUE_HIDDEN_COUNT; i++)
+    {
+        value[i] -= weight[i];
+    }
+#endif
+}
+
+// NOTE: Dot product of the clipped hidden values with the output weights
+Int32 get_nnue_output_sum(const Int16 *value, const Int16 *weight)
+{
+#if defined(__AVX2__)
+    __m256i zero = _mm256_setzero_si256();
+    __m256i clip = _mm256_set1_epi16(NNUE_CLIP);
+    __m256i sum = _mm256_setzero_si256();
+    for (Int i = 0; i < NNUE_HIDDEN_COUNT; i += 16)
+    {
+        __m256i clipped = _mm256_min_epi16(_mm256_max_epi16(_mm256_loadu_si256((__m256i *)(value + i)), zero), clip);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(clipped, _mm256_loadu_si256((__m256i *)(weight + i))));
+    }
+    __m128i half_sum = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half_sum = _mm_add_epi32(half_sum, _mm_shuffle_epi32(half_sum, 0x4e));
+    half_sum = _mm_add_epi32(half_sum, _mm_shuffle_epi32(half_sum, 0xb1));
+    Int32 result = _mm_cvtsi128_si32(half_sum);
+    return result;
+#elif defined(__SSE4_1__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i clip = _mm_set1_epi16(NNUE_CLIP);
+    __m128i sum = _mm_setzero_si128();
+    for (Int i = 0; i < NNUE_HIDDEN_COUNT; i += 8)
+    {
+        __m128i clipped = _mm_min_epi16(_mm_max_epi16(_mm_loadu_si128((__m128i *)(value + i)), zero), clip);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(clipped, _mm_loadu_si128((__m128i *)(weight + i))));
+    }
+    Int32 result = _mm_extract_epi32(sum, 0) + _mm_extract_epi32(sum, 1) + _mm_extract_epi32(sum, 2) + _mm_extract_epi32(sum, 3);
+    return result;
+#else
+    Int32 result = 0;
+    for (Int i = 0; i < NNUE_HIDDEN_COUNT; i++)
+    {
+        Int32 clipped = MIN(MAX(value[i], 0), NNUE_CLIP);
+        result += clipped * weight[i];
+    }
+    return result;
+#endif
+}
+
+// NOTE: Called with the piece already placed or still on the board, only the king squares are read from the position
+Void update_nnue_accumulator(NnueAccumulator *accumulator, SearchPosition *position, Square square, GamePiece piece, Bool add)
+{
+    GameSideEnum side = get_side(piece);
+    GamePieceTypeEnum piece_type = get_piece_type(piece);
+    for (GameSideEnum perspective = 0; perspective < GameSide::count; perspective++)
+    {
+        if (!accumulator->valid[perspective])
+        {
+            continue;
+        }
+        if (piece_type == GamePieceType::king)
+        {
+            if (side == perspective)
+            {
+                accumulator->valid[perspective] = false;
+            }
+            continue;
+        }
+
+        BitBoard king = position->occupancy_side[perspective] & position->occupancy_piece_type[GamePieceType::king];
+        ASSERT(king);
+        Int feature = get_nnue_feature(perspective, first_set(king), side, piece_type, square);
+        if (add)
+        {
+            add_nnue_weight(accumulator->value[perspective], nnue_network->feature_weight[feature]);
+        }
+        else
+        {
+            subtract_nnue_weight(accumulator->value[perspective], nnue_network->feature_weight[feature]);
+        }
+    }
+}
+
+Void refresh_nnue_accumulator(NnueAccumulator *accumulator, SearchPosition *position, GameSideEnum perspective)
+{
+    Int16 *value = accumulator->value[perspective];
+    memcpy(value, nnue_network->feature_bias, sizeof(nnue_network->feature_bias));
+
+    BitBoard king = position->occupancy_side[perspective] & position->occupancy_piece_type[GamePieceType::king];
+    ASSERT(king);
+    Square king_square = first_set(king);
+    for (GameSideEnum side = 0; side < GameSide::count; side++)
+    {
+        for (GamePieceTypeEnum piece_type = 0; piece_type < GamePieceType::king; piece_type++)
+        {
+            BitBoard occupancy = position->occupancy_side[side] & position->occupancy_piece_type[piece_type];
+            while (occupancy)
+            {
+                Square square = first_set(occupancy);
+                occupancy &= occupancy - 1;
+                add_nnue_weight(value, nnue_network->feature_weight[get_nnue_feature(perspective, king_square, side, piece_type, square)]);
+            }
+        }
+    }
+    accumulator->valid[perspective] = true;
+}
+
+// NOTE: Value is from the side to move
+Int eval_nnue(SearchPosition *position, NnueAccumulator *accumulator)
+{
+    ASSERT(nnue_network);
+    for (GameSideEnum perspective = 0; perspective < GameSide::count; perspective++)
+    {
+        if (!accumulator->valid[perspective])
+        {
+            refresh_nnue_accumulator(accumulator, position, perspective);
+        }
+    }
+
+    GameSideEnum side = position->current_side;
+    Int32 sum = nnue_network->output_bias;
+    sum += get_nnue_output_sum(accumulator->value[side], nnue_network->output_weight[0]);
+    sum += get_nnue_output_sum(accumulator->value[oppose(side)], nnue_network->output_weight[1]);
+    Int value = sum / nnue_network->output_divisor;
+    return value;
+}
+
+struct NnueFileHeader
+{
+    UInt32 magic;
+    UInt32 version;
+    UInt32 feature_count;
+    UInt32 hidden_count;
+    Int32 output_bias;
+    Int32 output_divisor;
+};
+
+// NOTE: Weight file is the header followed by the feature biases, the feature weights by feature and the output weights,
+// all little endian int16
+Bool deserialise_nnue_network(Str buffer, NnueNetwork *network)
+{
+    if (buffer.count != (Int)(sizeof(NnueFileHeader) + sizeof(network->feature_bias) + sizeof(network->feature_weight) + sizeof(network->output_weight)))
+    {
+        return false;
+    }
+    NnueFileHeader *header = (NnueFileHeader *)buffer.data;
+    if (header->magic != NNUE_FILE_MAGIC || header->version != NNUE_FILE_VERSION || header->feature_count != NNUE_FEATURE_COUNT ||
+        header->hidden_count != NNUE_HIDDEN_COUNT || header->output_divisor <= 0)
+    {
+        return false;
+    }
+    network->output_bias = header->output_bias;
+    network->output_divisor = header->output_divisor;
+
+    Int pos = sizeof(NnueFileHeader);
+    memcpy(network->feature_bias, buffer.data + pos, sizeof(network->feature_bias));
+    pos += sizeof(network->feature_bias);
+    memcpy(network->feature_weight, buffer.data + pos, sizeof(network->feature_weight));
+    pos += sizeof(network->feature_weight);
+    memcpy(network->output_weight, buffer.data + pos, sizeof(network->output_weight));
+    return true;
+}
+
+Str serialise_nnue_network(NnueNetwork *network)
+{
+    Str buffer;
+    buffer.count = sizeof(NnueFileHeader) + sizeof(network->feature_bias) + sizeof(network->feature_weight) + sizeof(network->output_weight);
+    buffer.data = (UInt8 *)malloc(buffer.count);
+
+    NnueFileHeader *header = (NnueFileHeader *)buffer.data;
+    header->magic = NNUE_FILE_MAGIC;
+    header->version = NNUE_FILE_VERSION;
+    header->feature_count = NNUE_FEATURE_COUNT;
+    header->hidden_count = NNUE_HIDDEN_COUNT;
+    header->output_bias = network->output_bias;
+    header->output_divisor = network->output_divisor;
+
+    Int pos = sizeof(NnueFileHeader);
+    memcpy(buffer.data + pos, network->feature_bias, sizeof(network->feature_bias));
+    pos += sizeof(network->feature_bias);
+    memcpy(buffer.data + pos, network->feature_weight, sizeof(network->feature_weight));
+    pos += sizeof(network->feature_weight);
+    memcpy(buffer.data + pos, network->output_weight, sizeof(network->output_weight));
+    return buffer;
+}
+
+#define NNUE_RAMP_COUNT (64)
+
+// NOTE: No trained weights ship with the game. This builds a network that computes material plus middle game square
+// values exactly, for testing the incremental updates and the kernels and as a baseline to compare against. Every ramp
+// neuron holds the same sum shifted by its bias, so the clipped neurons add up to the unclipped sum over a range of
+// NNUE_RAMP_COUNT * NNUE_CLIP. The side to move counts positive and the other side negative, which cancels the shifts.
+Void initialize_square_value_nnue_network(NnueNetwork *network)
+{
+    memset(network, 0, sizeof(NnueNetwork));
+    for (Int i = 0; i < NNUE_RAMP_COUNT; i++)
+    {
+        network->feature_bias[i] = (Int16)((NNUE_RAMP_COUNT / 2 - i) * NNUE_CLIP);
+        network->output_weight[0][i] = 1;
+        network->output_weight[1][i] = -1;
+    }
+    network->output_bias = 0;
+    network->output_divisor = 2;
+
+    for (Square king_square = 0; king_square < 64; king_square++)
+    {
+        for (GameSideEnum side = 0; side < GameSide::count; side++)
+        {
+            for (GamePieceTypeEnum piece_type = 0; piece_type < GamePieceType::king; piece_type++)
+            {
+                for (Square square = 0; square < 64; square++)
+                {
+                    Int value = piece_material_values[piece_type] + piece_square_values[side][piece_type][square].middle;
+                    Int16 weight = (Int16)(side == GameSide::white ? value : -value);
+                    Int feature = get_nnue_feature(GameSide::white, king_square, side, piece_type, square);
+                    for (Int i = 0; i < NNUE_RAMP_COUNT; i++)
+                    {
+                        network->feature_weight[feature][i] = weight;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -2,19 +2,14 @@
 
 #include "game.cpp"
 
-struct ValuePair
-{
-    Int middle;
-    Int end;
-};
-
-ValuePair operator-(ValuePair x, ValuePair y)
-{
-    ValuePair result;
-    result.middle = x.middle - y.middle;
-    result.middle = x.end - y.end;
-    return result;
-}
+// NOTE: Tuning builds define EVAL_TRACE, eval then reports every parameter it reads together with how many times it
+// counts for the side, so that the value can be written as a linear function of the parameters
+#if defined(EVAL_TRACE)
+Void trace_eval(Int *parameter, GameSideEnum side, Real64 middle, Real64 end);
+#define TRACE_EVAL(parameter, side, middle, end) trace_eval(&(parameter), side, middle, end)
+#else
+#define TRACE_EVAL(parameter, side, middle, end)
+#endif
 
 Int material_values[GamePieceType::count] = {100, 325, 335, 500, 975, 0};
 
@@ -27,20 +22,9 @@ struct MaterialValue
 
 MaterialValue eval_material(GameState *state, GameSideEnum side)
 {
-    MaterialValue value = {};
-    for (GamePieceTypeEnum piece_type = GamePieceType::pawn; piece_type < GamePieceType::king; piece_type++)
-    {
-        BitBoard occupancy = get_occupancy(state, side, piece_type);
-        Int piece_count = bit_count(occupancy);
-        if (piece_type == GamePieceType::pawn)
-        {
-            value.pawn += piece_count * material_values[piece_type];
-        }
-        else
-        {
-            value.non_pawn += piece_count * material_values[piece_type];
-        }
-    }
+    MaterialValue value;
+    value.pawn = state->material_pawn[side];
+    value.non_pawn = state->material_non_pawn[side];
     value.all = value.pawn + value.non_pawn;
     return value;
 }
@@ -127,60 +111,121 @@ Int king_square_values_end[8][8] = {
 
 ValuePair eval_square(GameState *state, GameSideEnum side)
 {
-    ValuePair value = {};
+    ValuePair value = state->square_value[side];
+    return value;
+}
+
+Int phase_values[GamePieceType::count] = {0, 1, 1, 2, 4, 0};
+
+// NOTE: Bumped whenever the eval tables are rebuilt, cached pawn structures and eval values from other tables no longer
+// match
+UInt32 eval_generation;
+
+Void initialize_eval_tables()
+{
+    eval_generation++;
     for (GamePieceTypeEnum piece_type = 0; piece_type < GamePieceType::count; piece_type++)
     {
-        BitBoard occupancy = get_occupancy(state, side, piece_type);
-        while (occupancy)
+        piece_material_values[piece_type] = material_values[piece_type];
+        piece_phase_values[piece_type] = phase_values[piece_type];
+    }
+
+    for (GameSideEnum side = 0; side < GameSide::count; side++)
+    {
+        for (GamePieceTypeEnum piece_type = 0; piece_type < GamePieceType::count; piece_type++)
         {
-            BitBoard square_bit = occupancy & -occupancy;
-            occupancy -= square_bit;
-            Square square = first_set(square_bit);
-            Square row_rel = get_row_rel(square, side);
-            Square column_rel = get_column_rel(square, side);
+            for (Square square = 0; square < 64; square++)
+            {
+                Square row_rel = get_row_rel(square, side);
+                Square column_rel = get_column_rel(square, side);
+                ValuePair value;
+                if (piece_type == GamePieceType::king)
+                {
+                    value.middle = king_square_values_middle[row_rel][column_rel];
+                    value.end = king_square_values_end[row_rel][column_rel];
+                }
+                else
+                {
+                    value.middle = square_values[piece_type][row_rel][column_rel];
+                    value.end = square_values[piece_type][row_rel][column_rel];
+                }
+                piece_square_values[side][piece_type][square] = value;
+            }
+        }
+    }
+}
 
-            if (piece_type == GamePieceType::king)
+// NOTE: Recomputes the accumulators from the bitboards, for checking the incremental updates
+Bool check_eval_accumulators(GameState *state)
+{
+    Int phase = 0;
+    for (GameSideEnum side = 0; side < GameSide::count; side++)
+    {
+        Int pawn = 0;
+        Int non_pawn = 0;
+        ValuePair square_value = {};
+        for (GamePieceTypeEnum piece_type = 0; piece_type < GamePieceType::count; piece_type++)
+        {
+            BitBoard occupancy = get_occupancy(state, side, piece_type);
+            Int piece_count = bit_count(occupancy);
+            if (piece_type == GamePieceType::pawn)
             {
-                value.middle += king_square_values_middle[row_rel][column_rel];
-                value.end += king_square_values_end[row_rel][column_rel];
+                pawn += piece_count * material_values[piece_type];
             }
             else
             {
-                value.middle += square_values[piece_type][row_rel][column_rel];
-                value.end += square_values[piece_type][row_rel][column_rel];
+                non_pawn += piece_count * material_values[piece_type];
             }
+            phase += piece_count * phase_values[piece_type];
+
+            while (occupancy)
+            {
+                Square square = first_set(occupancy);
+                occupancy &= occupancy - 1;
+                square_value = square_value + piece_square_values[side][piece_type][square];
+            }
+        }
+
+        if (pawn != state->material_pawn[side] || non_pawn != state->material_non_pawn[side] ||
+            square_value.middle != state->square_value[side].middle || square_value.end != state->square_value[side].end)
+        {
+            return false;
         }
     }
-    return value;
+    Bool result = phase == state->phase;
+    return result;
 }
 
 Int knight_pawn_adjust_values[9] = {-20, -16, -12, -8, -4, 0, 4, 8, 12};
 Int rook_pawn_adjust_values[9] = {15, 12, 9, 6, 3, 0, -3, -6, -9};
 
-Int eval_material_adjust(GameState *state, GameSideEnum side)
+template <GameSideEnum Side>
+Int eval_material_adjust(GameState *state)
 {
     Int value = 0;
-    Int bishop_count = bit_count(get_occupancy(state, side, GamePieceType::bishop));
+    Int bishop_count = bit_count(get_occupancy(state, Side, GamePieceType::bishop));
     if (bishop_count > 1)
     {
         value += 30;
     }
 
-    Int knight_count = bit_count(get_occupancy(state, side, GamePieceType::knight));
+    Int knight_count = bit_count(get_occupancy(state, Side, GamePieceType::knight));
     if (knight_count > 1)
     {
         value -= 8;
     }
 
-    Int rook_count = bit_count(get_occupancy(state, side, GamePieceType::rook));
+    Int rook_count = bit_count(get_occupancy(state, Side, GamePieceType::rook));
     if (rook_count > 1)
     {
         value -= 16;
     }
 
-    Int pawn_count = bit_count(get_occupancy(state, side, GamePieceType::pawn));
+    Int pawn_count = bit_count(get_occupancy(state, Side, GamePieceType::pawn));
     value += knight_pawn_adjust_values[pawn_count] * knight_count;
     value += rook_pawn_adjust_values[pawn_count] * rook_count;
+    TRACE_EVAL(knight_pawn_adjust_values[pawn_count], Side, knight_count, knight_count);
+    TRACE_EVAL(rook_pawn_adjust_values[pawn_count], Side, rook_count, rook_count);
     return value;
 }
 
@@ -206,11 +251,13 @@ Int weak_pawn_values[8][8] = {
     {0, 0, 0, 0, 0, 0, 0, 0},
 };
 
-Int eval_pawn_structure(GameState *state, GameSideEnum side)
+template <GameSideEnum Side>
+Int eval_pawn_structure(GameState *state, BitBoard *passed_occupancy)
 {
     Int value = 0;
-    GameSideEnum oppose_side = oppose(side);
-    BitBoard pawn_occupancy = get_occupancy(state, side, GamePieceType::pawn);
+    *passed_occupancy = 0;
+    constexpr GameSideEnum oppose_side = oppose(Side);
+    BitBoard pawn_occupancy = get_occupancy(state, Side, GamePieceType::pawn);
     BitBoard oppose_pawn_occupancy = get_occupancy(state, oppose_side, GamePieceType::pawn);
     BitBoard both_pawn_occupancy = pawn_occupancy | oppose_pawn_occupancy;
 
@@ -222,12 +269,12 @@ Int eval_pawn_structure(GameState *state, GameSideEnum side)
         Square pawn_square = first_set(pawn_bit);
         Square row = get_row(pawn_square);
         Square column = get_column(pawn_square);
-        Square row_rel = get_row_rel(pawn_square, side);
-        Square column_rel = get_column_rel(pawn_square, side);
+        Square row_rel = get_row_rel<Side>(pawn_square);
+        Square column_rel = get_column_rel<Side>(pawn_square);
 
         BitBoard column_mask = get_column_mask(column);
         BitBoard adj_column_mask = (column > 0 ? get_column_mask(column - 1) : 0) | (column < 7 ? get_column_mask(column + 1) : 0);
-        BitBoard forward_mask = get_forward_mask(row, side);
+        BitBoard forward_mask = get_forward_mask<Side>(row);
 
         BitBoard non_passed_mask = (adj_column_mask & forward_mask & oppose_pawn_occupancy) | (column_mask & forward_mask & both_pawn_occupancy);
         BitBoard opposed_mask = column_mask & forward_mask & oppose_pawn_occupancy;
@@ -242,12 +289,14 @@ Int eval_pawn_structure(GameState *state, GameSideEnum side)
         if (!non_passed_mask)
         {
             Int passed_value = passed_pawn_values[row_rel][column_rel];
-            BitBoard supported_mask = (left(pawn_bit, side) | right(pawn_bit, side) | down_left(pawn_bit, side) | down_right(pawn_bit, side)) & pawn_occupancy;
+            BitBoard supported_mask = (left<Side>(pawn_bit) | right<Side>(pawn_bit) | down_left<Side>(pawn_bit) | down_right<Side>(pawn_bit)) & pawn_occupancy;
             if (supported_mask)
             {
                 passed_value = passed_value * 10 / 8;
             }
             value += passed_value;
+            TRACE_EVAL(passed_pawn_values[row_rel][column_rel], Side, supported_mask ? 1.25 : 1, supported_mask ? 1.25 : 1);
+            *passed_occupancy |= pawn_bit;
         }
 
         if (!non_weak_mask)
@@ -258,20 +307,83 @@ Int eval_pawn_structure(GameState *state, GameSideEnum side)
                 weak_value -= 4;
             }
             value += weak_value;
+            TRACE_EVAL(weak_pawn_values[row_rel][column_rel], Side, 1, 1);
         }
     }
     return value;
 }
 
-ValuePair eval_mobility(GameState *state, GameSideEnum side)
+// NOTE: The pawn structure only depends on the pawns of both sides, so it is cached per pawn configuration and eval
+// generation
+struct PawnEntry
+{
+    UInt64 key;
+    BitBoard passed_occupancy[GameSide::count];
+    Int value;
+    UInt32 generation;
+};
+
+#define PAWN_TABLE_INDEX_BIT_COUNT (14)
+#define PAWN_TABLE_SIZE (1 << PAWN_TABLE_INDEX_BIT_COUNT)
+
+struct PawnTable
+{
+    PawnEntry *entries;
+    UInt64 hit_count;
+    UInt64 miss_count;
+};
+
+Bool initialize_pawn_table(PawnTable *pawn_table)
+{
+    pawn_table->entries = (PawnEntry *)malloc(PAWN_TABLE_SIZE * sizeof(PawnEntry));
+    if (!pawn_table->entries)
+    {
+        return false;
+    }
+    memset(pawn_table->entries, 0, PAWN_TABLE_SIZE * sizeof(PawnEntry));
+    pawn_table->hit_count = 0;
+    pawn_table->miss_count = 0;
+    return true;
+}
+
+Void eval_pawn_entry(GameState *state, PawnEntry *entry)
+{
+    entry->key = state->pawn_zobrist;
+    entry->generation = eval_generation;
+    entry->value = eval_pawn_structure<GameSide::white>(state, &entry->passed_occupancy[GameSide::white]) -
+                   eval_pawn_structure<GameSide::black>(state, &entry->passed_occupancy[GameSide::black]);
+}
+
+PawnEntry *probe_pawn_table(PawnTable *pawn_table, GameState *state)
+{
+    PawnEntry *entry = &pawn_table->entries[state->pawn_zobrist >> (64 - PAWN_TABLE_INDEX_BIT_COUNT)];
+    if (entry->key == state->pawn_zobrist && entry->generation == eval_generation)
+    {
+        pawn_table->hit_count++;
+    }
+    else
+    {
+        pawn_table->miss_count++;
+        eval_pawn_entry(state, entry);
+    }
+    return entry;
+}
+
+// NOTE: Value per reachable square not controlled by enemy pawns, counted from the typical mobility of the piece
+Int mobility_values_middle[GamePieceType::count] = {0, 4, 3, 2, 1, 0};
+Int mobility_values_end[GamePieceType::count] = {0, 4, 3, 4, 2, 0};
+Int mobility_offsets[GamePieceType::count] = {0, 4, 7, 7, 14, 0};
+
+template <GameSideEnum Side>
+ValuePair eval_mobility(GameState *state)
 {
     ValuePair value = {};
-    GameSideEnum oppose_side = oppose(side);
+    constexpr GameSideEnum oppose_side = oppose(Side);
     BitBoard oppose_pawn_occupancy = get_occupancy(state, oppose_side, GamePieceType::pawn);
-    BitBoard oppose_pawn_control = up_left(oppose_pawn_occupancy, oppose_side) | up_right(oppose_pawn_occupancy, oppose_side);
+    BitBoard oppose_pawn_control = up_left<oppose_side>(oppose_pawn_occupancy) | up_right<oppose_side>(oppose_pawn_occupancy);
     for (GamePieceTypeEnum piece_type = GamePieceType::knight; piece_type <= GamePieceType::queen; piece_type++)
     {
-        BitBoard occupancy = get_occupancy(state, side, piece_type);
+        BitBoard occupancy = get_occupancy(state, Side, piece_type);
         while (occupancy)
         {
             BitBoard square_bit = occupancy & -occupancy;
@@ -282,74 +394,48 @@ ValuePair eval_mobility(GameState *state, GameSideEnum side)
             {
             case GamePieceType::knight:
             {
-                move = check_knight_move(state, square, side);
+                move = check_knight_move(state, square, Side);
             }
             break;
 
             case GamePieceType::bishop:
             {
-                move = check_bishop_move(state, square, side);
+                move = check_bishop_move(state, square, Side);
             }
             break;
 
             case GamePieceType::rook:
             {
-                move = check_rook_move(state, square, side);
+                move = check_rook_move(state, square, Side);
             }
             break;
 
             case GamePieceType::queen:
             {
-                move = check_queen_move(state, square, side);
+                move = check_queen_move(state, square, Side);
             }
             break;
             }
             BitBoard mobility_mask = move & ~oppose_pawn_control;
-            Int mobility = bit_count(mobility_mask);
-
-            switch (piece_type)
-            {
-            case GamePieceType::knight:
-            {
-                value.middle += 4 * (mobility - 4);
-                value.end += 4 * (mobility - 4);
-            }
-            break;
-
-            case GamePieceType::bishop:
-            {
-                value.middle += 3 * (mobility - 7);
-                value.end += 3 * (mobility - 7);
-            }
-            break;
-
-            case GamePieceType::rook:
-            {
-                value.middle += 2 * (mobility - 7);
-                value.end += 4 * (mobility - 7);
-            }
-            break;
-
-            case GamePieceType::queen:
-            {
-                value.middle += 1 * (mobility - 14);
-                value.end += 2 * (mobility - 14);
-            }
-            break;
-            }
+            Int mobility = bit_count(mobility_mask) - mobility_offsets[piece_type];
+            value.middle += mobility_values_middle[piece_type] * mobility;
+            value.end += mobility_values_end[piece_type] * mobility;
+            TRACE_EVAL(mobility_values_middle[piece_type], Side, mobility, 0);
+            TRACE_EVAL(mobility_values_end[piece_type], Side, 0, mobility);
         }
     }
     return value;
 }
 
-ValuePair eval_theme(GameState *state, GameSideEnum side)
+template <GameSideEnum Side>
+ValuePair eval_theme(GameState *state)
 {
     ValuePair value = {};
     // NOTE: Bishop support castled king
-    BitBoard bishop_occupancy = get_occupancy(state, side, GamePieceType::bishop);
-    BitBoard king_occupancy = get_occupancy(state, side, GamePieceType::king);
-    BitBoard bishop_support_mask[2] = {bit_square(get_abs_square(Sq::c1, side)), bit_square(get_abs_square(Sq::f1, side))};
-    BitBoard king_support_mask[2] = {bit_square(get_abs_square(Sq::b1, side)), bit_square(get_abs_square(Sq::g1, side))};
+    BitBoard bishop_occupancy = get_occupancy(state, Side, GamePieceType::bishop);
+    BitBoard king_occupancy = get_occupancy(state, Side, GamePieceType::king);
+    BitBoard bishop_support_mask[2] = {bit_square(get_abs_square<Side>(Sq::c1)), bit_square(get_abs_square<Side>(Sq::f1))};
+    BitBoard king_support_mask[2] = {bit_square(get_abs_square<Side>(Sq::b1)), bit_square(get_abs_square<Side>(Sq::g1))};
     for (Int i = 0; i < 2; i++)
     {
         if ((bishop_support_mask[i] & bishop_occupancy) && (king_support_mask[i] & king_occupancy))
@@ -360,20 +446,20 @@ ValuePair eval_theme(GameState *state, GameSideEnum side)
     }
 
     // NOTE: Rook / Queen near enemy king line
-    GameSideEnum oppose_side = oppose(side);
+    constexpr GameSideEnum oppose_side = oppose(Side);
     Square oppose_king_square = first_set(get_occupancy(state, oppose_side, GamePieceType::king));
-    Square oppose_king_row_rel = get_row_rel(oppose_king_square, side);
+    Square oppose_king_row_rel = get_row_rel<Side>(oppose_king_square);
     BitBoard oppose_pawn_occupancy = get_occupancy(state, oppose_side, GamePieceType::pawn);
     for (GamePieceTypeEnum piece_type = GamePieceType::rook; piece_type <= GamePieceType::queen; piece_type++)
     {
-        BitBoard occupancy = get_occupancy(state, side, piece_type);
+        BitBoard occupancy = get_occupancy(state, Side, piece_type);
         while (occupancy)
         {
             BitBoard square_bit = occupancy & -occupancy;
             occupancy -= square_bit;
             Square square = first_set(square_bit);
             Square row = get_row(square);
-            Square row_rel = get_row_rel(square, side);
+            Square row_rel = get_row_rel<Side>(square);
             if (row_rel == 6 && (oppose_king_row_rel == 7 || (oppose_pawn_occupancy & get_row_mask(row))))
             {
                 switch (piece_type)
@@ -397,8 +483,8 @@ ValuePair eval_theme(GameState *state, GameSideEnum side)
     }
 
     // NOTE: Rook open columns
-    BitBoard rook_occupancy = get_occupancy(state, side, GamePieceType::rook);
-    BitBoard pawn_occupancy = get_occupancy(state, side, GamePieceType::pawn);
+    BitBoard rook_occupancy = get_occupancy(state, Side, GamePieceType::rook);
+    BitBoard pawn_occupancy = get_occupancy(state, Side, GamePieceType::pawn);
     while (rook_occupancy)
     {
         BitBoard square_bit = rook_occupancy & -rook_occupancy;
@@ -423,21 +509,21 @@ ValuePair eval_theme(GameState *state, GameSideEnum side)
     }
 
     // NOTE: Queen moves too early
-    BitBoard queen_occupancy = get_occupancy(state, side, GamePieceType::queen);
+    BitBoard queen_occupancy = get_occupancy(state, Side, GamePieceType::queen);
     while (queen_occupancy)
     {
         BitBoard square_bit = queen_occupancy & -queen_occupancy;
         queen_occupancy -= square_bit;
         Square square = first_set(square_bit);
-        Square row_rel = get_row_rel(square, side);
+        Square row_rel = get_row_rel<Side>(square);
         if (row_rel > 1)
         {
-            BitBoard knight_occupancy = get_occupancy(state, side, GamePieceType::knight);
-            BitBoard knight_initial_mask = bit_square(get_abs_square(Sq::b1, side)) | bit_square(get_abs_square(Sq::g1, side));
+            BitBoard knight_occupancy = get_occupancy(state, Side, GamePieceType::knight);
+            BitBoard knight_initial_mask = bit_square(get_abs_square<Side>(Sq::b1)) | bit_square(get_abs_square<Side>(Sq::g1));
             Int non_moved_knight_count = bit_count(knight_occupancy & knight_initial_mask);
 
-            BitBoard bishop_occupancy = get_occupancy(state, side, GamePieceType::bishop);
-            BitBoard bishop_initial_mask = bit_square(get_abs_square(Sq::c1, side)) | bit_square(get_abs_square(Sq::f1, side));
+            BitBoard bishop_occupancy = get_occupancy(state, Side, GamePieceType::bishop);
+            BitBoard bishop_initial_mask = bit_square(get_abs_square<Side>(Sq::c1)) | bit_square(get_abs_square<Side>(Sq::f1));
             Int non_moved_bishop_count = bit_count(bishop_occupancy & bishop_initial_mask);
 
             value.middle -= (non_moved_knight_count + non_moved_bishop_count) * 2;
@@ -448,18 +534,19 @@ ValuePair eval_theme(GameState *state, GameSideEnum side)
     return value;
 }
 
-Int eval_blockage(GameState *state, GameSideEnum side)
+template <GameSideEnum Side>
+Int eval_blockage(GameState *state)
 {
     Int value = 0;
     // NOTE: Central pawn block initial bishop
     BitBoard both_occupancy = get_occupancy(state);
-    BitBoard pawn_occupancy = get_occupancy(state, side, GamePieceType::pawn);
-    BitBoard bishop_occupancy = get_occupancy(state, side, GamePieceType::bishop);
-    BitBoard central_pawn_mask[2] = {bit_square(get_abs_square(Sq::d2, side)), bit_square(get_abs_square(Sq::e2, side))};
-    BitBoard initial_bishop_mask[2] = {bit_square(get_abs_square(Sq::c1, side)), bit_square(get_abs_square(Sq::f1, side))};
+    BitBoard pawn_occupancy = get_occupancy(state, Side, GamePieceType::pawn);
+    BitBoard bishop_occupancy = get_occupancy(state, Side, GamePieceType::bishop);
+    BitBoard central_pawn_mask[2] = {bit_square(get_abs_square<Side>(Sq::d2)), bit_square(get_abs_square<Side>(Sq::e2))};
+    BitBoard initial_bishop_mask[2] = {bit_square(get_abs_square<Side>(Sq::c1)), bit_square(get_abs_square<Side>(Sq::f1))};
     for (Int i = 0; i < 2; i++)
     {
-        BitBoard blocking_pawn_mask = up(central_pawn_mask[i], side);
+        BitBoard blocking_pawn_mask = up<Side>(central_pawn_mask[i]);
         if ((central_pawn_mask[i] & pawn_occupancy) && (initial_bishop_mask[i] & bishop_occupancy) && (blocking_pawn_mask & both_occupancy))
         {
             value -= 24;
@@ -467,12 +554,12 @@ Int eval_blockage(GameState *state, GameSideEnum side)
     }
 
     // NOTE: Trapped knight at oppose corner
-    BitBoard knight_occupancy = get_occupancy(state, side, GamePieceType::knight);
-    BitBoard oppose_pawn_occupancy = get_occupancy(state, oppose(side), GamePieceType::pawn);
-    BitBoard trapped_knight_mask[2] = {bit_square(get_abs_square(Sq::a8, side)), bit_square(get_abs_square(Sq::h8, side))};
-    BitBoard knight_blocking_pawn_mask[2] = {bit_square(get_abs_square(Sq::a7, side)) | bit_square(get_abs_square(Sq::c7, side)), bit_square(get_abs_square(Sq::h7, side)) | bit_square(get_abs_square(Sq::f7, side))};
-    BitBoard trapped_knight_mask2[2] = {bit_square(get_abs_square(Sq::a7, side)), bit_square(get_abs_square(Sq::h7, side))};
-    BitBoard knight_blocking_pawn_mask2[2] = {bit_square(get_abs_square(Sq::a6, side)) | bit_square(get_abs_square(Sq::b7, side)), bit_square(get_abs_square(Sq::h6, side)) | bit_square(get_abs_square(Sq::g7, side))};
+    BitBoard knight_occupancy = get_occupancy(state, Side, GamePieceType::knight);
+    BitBoard oppose_pawn_occupancy = get_occupancy(state, oppose(Side), GamePieceType::pawn);
+    BitBoard trapped_knight_mask[2] = {bit_square(get_abs_square<Side>(Sq::a8)), bit_square(get_abs_square<Side>(Sq::h8))};
+    BitBoard knight_blocking_pawn_mask[2] = {bit_square(get_abs_square<Side>(Sq::a7)) | bit_square(get_abs_square<Side>(Sq::c7)), bit_square(get_abs_square<Side>(Sq::h7)) | bit_square(get_abs_square<Side>(Sq::f7))};
+    BitBoard trapped_knight_mask2[2] = {bit_square(get_abs_square<Side>(Sq::a7)), bit_square(get_abs_square<Side>(Sq::h7))};
+    BitBoard knight_blocking_pawn_mask2[2] = {bit_square(get_abs_square<Side>(Sq::a6)) | bit_square(get_abs_square<Side>(Sq::b7)), bit_square(get_abs_square<Side>(Sq::h6)) | bit_square(get_abs_square<Side>(Sq::g7))};
     for (Int i = 0; i < 2; i++)
     {
         if ((trapped_knight_mask[i] & knight_occupancy) && (knight_blocking_pawn_mask[i] & oppose_pawn_occupancy))
@@ -486,10 +573,10 @@ Int eval_blockage(GameState *state, GameSideEnum side)
     }
 
     // NOTE: Trapped bishop at oppose corner
-    BitBoard trapped_bishop_mask[4] = {bit_square(get_abs_square(Sq::a7, side)), bit_square(get_abs_square(Sq::h7, side)), bit_square(get_abs_square(Sq::b8, side)), bit_square(get_abs_square(Sq::g8, side))};
-    BitBoard bishop_blocking_pawn_mask[4] = {bit_square(get_abs_square(Sq::b6, side)), bit_square(get_abs_square(Sq::g6, side)), bit_square(get_abs_square(Sq::c7, side)), bit_square(get_abs_square(Sq::f7, side))};
-    BitBoard trapped_bishop_mask2[2] = {bit_square(get_abs_square(Sq::a6, side)), bit_square(get_abs_square(Sq::h6, side))};
-    BitBoard bishop_blocking_pawn_mask2[2] = {bit_square(get_abs_square(Sq::b5, side)), bit_square(get_abs_square(Sq::g5, side))};
+    BitBoard trapped_bishop_mask[4] = {bit_square(get_abs_square<Side>(Sq::a7)), bit_square(get_abs_square<Side>(Sq::h7)), bit_square(get_abs_square<Side>(Sq::b8)), bit_square(get_abs_square<Side>(Sq::g8))};
+    BitBoard bishop_blocking_pawn_mask[4] = {bit_square(get_abs_square<Side>(Sq::b6)), bit_square(get_abs_square<Side>(Sq::g6)), bit_square(get_abs_square<Side>(Sq::c7)), bit_square(get_abs_square<Side>(Sq::f7))};
+    BitBoard trapped_bishop_mask2[2] = {bit_square(get_abs_square<Side>(Sq::a6)), bit_square(get_abs_square<Side>(Sq::h6))};
+    BitBoard bishop_blocking_pawn_mask2[2] = {bit_square(get_abs_square<Side>(Sq::b5)), bit_square(get_abs_square<Side>(Sq::g5))};
     for (Int i = 0; i < 2; i++)
     {
         if ((trapped_bishop_mask[i] & bishop_occupancy) && (bishop_blocking_pawn_mask[i] & oppose_pawn_occupancy))
@@ -503,10 +590,10 @@ Int eval_blockage(GameState *state, GameSideEnum side)
     }
 
     // NOTE: Uncastled king block rook
-    BitBoard king_occupancy = get_occupancy(state, side, GamePieceType::king);
-    BitBoard rook_occupancy = get_occupancy(state, side, GamePieceType::rook);
-    BitBoard blocking_king_mask[2] = {bit_square(get_abs_square(Sq::c1, side)) | bit_square(get_abs_square(Sq::b1, side)), bit_square(get_abs_square(Sq::f1, side)) | bit_square(get_abs_square(Sq::g1, side))};
-    BitBoard blocking_rook_mask[2] = {bit_square(get_abs_square(Sq::a1, side)) | bit_square(get_abs_square(Sq::b1, side)), bit_square(get_abs_square(Sq::h1, side)) | bit_square(get_abs_square(Sq::g1, side))};
+    BitBoard king_occupancy = get_occupancy(state, Side, GamePieceType::king);
+    BitBoard rook_occupancy = get_occupancy(state, Side, GamePieceType::rook);
+    BitBoard blocking_king_mask[2] = {bit_square(get_abs_square<Side>(Sq::c1)) | bit_square(get_abs_square<Side>(Sq::b1)), bit_square(get_abs_square<Side>(Sq::f1)) | bit_square(get_abs_square<Side>(Sq::g1))};
+    BitBoard blocking_rook_mask[2] = {bit_square(get_abs_square<Side>(Sq::a1)) | bit_square(get_abs_square<Side>(Sq::b1)), bit_square(get_abs_square<Side>(Sq::h1)) | bit_square(get_abs_square<Side>(Sq::g1))};
     for (Int i = 0; i < 2; i++)
     {
         if ((blocking_king_mask[i] & king_occupancy) && (blocking_rook_mask[i] & rook_occupancy))
@@ -516,10 +603,10 @@ Int eval_blockage(GameState *state, GameSideEnum side)
     }
 
     // NOTE: Knight block queen side pawn
-    if ((knight_occupancy & bit_square(get_abs_square(Sq::c3, side))) &&
-        (pawn_occupancy & bit_square(get_abs_square(Sq::c2, side))) &&
-        (pawn_occupancy & bit_square(get_abs_square(Sq::d4, side))) &&
-        !(pawn_occupancy & bit_square(get_abs_square(Sq::e4, side))))
+    if ((knight_occupancy & bit_square(get_abs_square<Side>(Sq::c3))) &&
+        (pawn_occupancy & bit_square(get_abs_square<Side>(Sq::c2))) &&
+        (pawn_occupancy & bit_square(get_abs_square<Side>(Sq::d4))) &&
+        !(pawn_occupancy & bit_square(get_abs_square<Side>(Sq::e4))))
     {
         value -= 5;
     }
@@ -538,18 +625,19 @@ Int attack_values[100] = {0, 0, 1, 2, 3, 5, 7, 9, 12, 15,
                           500, 500, 500, 500, 500, 500, 500, 500, 500, 500,
                           500, 500, 500, 500, 500, 500, 500, 500, 500, 500};
 
-Int eval_attack(GameState *state, GameSideEnum side)
+template <GameSideEnum Side>
+Int eval_attack(GameState *state)
 {
     Int count = 0;
     Int weight = 0;
-    GameSideEnum oppose_side = oppose(side);
+    constexpr GameSideEnum oppose_side = oppose(Side);
     BitBoard king_bit = get_occupancy(state, oppose_side, GamePieceType::king);
     Square king_square = first_set(king_bit);
-    BitBoard king_move = state->bit_board_table->king_table.move[king_square];
-    BitBoard near_king_mask = (king_move | up(king_move, oppose_side)) & ~king_bit;
+    BitBoard king_move = bit_board_table.king_table.move[king_square];
+    BitBoard near_king_mask = (king_move | up<oppose_side>(king_move)) & ~king_bit;
     for (GamePieceTypeEnum piece_type = GamePieceType::knight; piece_type <= GamePieceType::queen; piece_type++)
     {
-        BitBoard occupancy = get_occupancy(state, side, piece_type);
+        BitBoard occupancy = get_occupancy(state, Side, piece_type);
         while (occupancy)
         {
             BitBoard square_bit = occupancy & -occupancy;
@@ -560,25 +648,25 @@ Int eval_attack(GameState *state, GameSideEnum side)
             {
             case GamePieceType::knight:
             {
-                move = check_knight_move(state, square, side);
+                move = check_knight_move(state, square, Side);
             }
             break;
 
             case GamePieceType::bishop:
             {
-                move = check_bishop_move(state, square, side);
+                move = check_bishop_move(state, square, Side);
             }
             break;
 
             case GamePieceType::rook:
             {
-                move = check_rook_move(state, square, side);
+                move = check_rook_move(state, square, Side);
             }
             break;
 
             case GamePieceType::queen:
             {
-                move = check_queen_move(state, square, side);
+                move = check_queen_move(state, square, Side);
             }
             break;
             }
@@ -615,7 +703,7 @@ Int eval_attack(GameState *state, GameSideEnum side)
         }
     }
 
-    BitBoard queen_occupancy = get_occupancy(state, side, GamePieceType::queen);
+    BitBoard queen_occupancy = get_occupancy(state, Side, GamePieceType::queen);
     Int queen_count = bit_count(queen_occupancy);
     if (count < 2 || queen_count == 0)
     {
@@ -623,14 +711,23 @@ Int eval_attack(GameState *state, GameSideEnum side)
     }
 
     Int value = attack_values[weight];
+    TRACE_EVAL(attack_values[weight], Side, 1, 1);
     return value;
 }
 
-ValuePair eval_safety(GameState *state, GameSideEnum side)
+// NOTE: Value per square of distance between the king and each enemy piece, counted from the far side of the board
+Int safety_values_middle[GamePieceType::count] = {0, 3, 2, 2, 2, 0};
+Int safety_values_end[GamePieceType::count] = {0, 3, 1, 1, 4, 0};
+
+// NOTE: Value per shield pawn right in front of the castled king, or one row further up if there are none
+Int pawn_shield_values[2] = {10, 5};
+
+template <GameSideEnum Side>
+ValuePair eval_safety(GameState *state)
 {
     ValuePair value = {};
-    GameSideEnum oppose_side = oppose(side);
-    Square king_square = first_set(get_occupancy(state, side, GamePieceType::king));
+    constexpr GameSideEnum oppose_side = oppose(Side);
+    Square king_square = first_set(get_occupancy(state, Side, GamePieceType::king));
     for (GamePieceTypeEnum piece_type = GamePieceType::knight; piece_type <= GamePieceType::queen; piece_type++)
     {
         BitBoard occupancy = get_occupancy(state, oppose_side, piece_type);
@@ -642,43 +739,16 @@ ValuePair eval_safety(GameState *state, GameSideEnum side)
 
             Int distance = ABS(get_row(square) - get_row(king_square)) + ABS(get_column(square) - get_column(king_square));
             Int safety = distance - 7;
-
-            switch (piece_type)
-            {
-            case GamePieceType::knight:
-            {
-                value.middle += 3 * safety;
-                value.end += 3 * safety;
-            }
-            break;
-
-            case GamePieceType::bishop:
-            {
-                value.middle += 2 * safety;
-                value.end += 1 * safety;
-            }
-            break;
-
-            case GamePieceType::rook:
-            {
-                value.middle += 2 * safety;
-                value.end += 1 * safety;
-            }
-            break;
-
-            case GamePieceType::queen:
-            {
-                value.middle += 2 * safety;
-                value.end += 4 * safety;
-            }
-            break;
-            }
+            value.middle += safety_values_middle[piece_type] * safety;
+            value.end += safety_values_end[piece_type] * safety;
+            TRACE_EVAL(safety_values_middle[piece_type], Side, safety, 0);
+            TRACE_EVAL(safety_values_end[piece_type], Side, 0, safety);
         }
     }
 
     // NOTE: Pawn shield
     Square column = get_column(king_square);
-    Int row_rel = get_row_rel(king_square, side);
+    Int row_rel = get_row_rel<Side>(king_square);
     if (row_rel == 0)
     {
         BitBoard shield_mask = 0;
@@ -693,31 +763,189 @@ ValuePair eval_safety(GameState *state, GameSideEnum side)
         if (shield_mask)
         {
             BitBoard shield_mask2 = shield_mask << 8;
-            if (side == GameSide::black)
+            if (Side == GameSide::black)
             {
                 shield_mask <<= 40;
                 shield_mask2 <<= 24;
             }
 
-            BitBoard pawn_occupancy = get_occupancy(state, side, GamePieceType::pawn);
+            BitBoard pawn_occupancy = get_occupancy(state, Side, GamePieceType::pawn);
             BitBoard shield = pawn_occupancy & shield_mask;
             BitBoard shield2 = pawn_occupancy & shield_mask2;
             if (shield)
             {
-                value.middle += 10 * bit_count(shield);
+                value.middle += pawn_shield_values[0] * bit_count(shield);
+                TRACE_EVAL(pawn_shield_values[0], Side, bit_count(shield), 0);
             }
             else if (shield2)
             {
-                value.middle += 5 * bit_count(shield2);
+                value.middle += pawn_shield_values[1] * bit_count(shield2);
+                TRACE_EVAL(pawn_shield_values[1], Side, bit_count(shield2), 0);
             }
         }
     }
     return value;
 }
 
-Int phase_values[GamePieceType::count] = {0, 1, 1, 2, 4, 0};
+Int tempo_value = 10;
+
+// NOTE: The tunable parameters in the order of the weight vector. The pattern bonuses of eval_theme and eval_blockage
+// and the doubled pawn penalty stay fixed.
+struct EvalParameter
+{
+    CStr name;
+    Int *values;
+    Int table_count;
+    Int row_count;
+    Int column_count;
+};
+
+EvalParameter eval_parameters[] = {
+    {"material_values", material_values, 1, 1, GamePieceType::count},
+    {"square_values", square_values[0][0], GamePieceType::count, 8, 8},
+    {"king_square_values_middle", king_square_values_middle[0], 1, 8, 8},
+    {"king_square_values_end", king_square_values_end[0], 1, 8, 8},
+    {"knight_pawn_adjust_values", knight_pawn_adjust_values, 1, 1, 9},
+    {"rook_pawn_adjust_values", rook_pawn_adjust_values, 1, 1, 9},
+    {"passed_pawn_values", passed_pawn_values[0], 1, 8, 8},
+    {"weak_pawn_values", weak_pawn_values[0], 1, 8, 8},
+    {"mobility_values_middle", mobility_values_middle, 1, 1, GamePieceType::count},
+    {"mobility_values_end", mobility_values_end, 1, 1, GamePieceType::count},
+    {"attack_values", attack_values, 1, 1, 100},
+    {"safety_values_middle", safety_values_middle, 1, 1, GamePieceType::count},
+    {"safety_values_end", safety_values_end, 1, 1, GamePieceType::count},
+    {"pawn_shield_values", pawn_shield_values, 1, 1, 2},
+    {"tempo_value", &tempo_value, 1, 1, 1},
+};
+
+#define EVAL_PARAMETER_COUNT ((Int)(sizeof(eval_parameters) / sizeof(eval_parameters[0])))
+
+Int get_eval_parameter_value_count(EvalParameter *parameter)
+{
+    Int result = parameter->table_count * parameter->row_count * parameter->column_count;
+    return result;
+}
+
+Int get_eval_weight_count()
+{
+    Int result = 0;
+    for (Int parameter_i = 0; parameter_i < EVAL_PARAMETER_COUNT; parameter_i++)
+    {
+        result += get_eval_parameter_value_count(&eval_parameters[parameter_i]);
+    }
+    return result;
+}
+
+Void get_eval_weights(Int *weights)
+{
+    for (Int parameter_i = 0; parameter_i < EVAL_PARAMETER_COUNT; parameter_i++)
+    {
+        EvalParameter *parameter = &eval_parameters[parameter_i];
+        Int value_count = get_eval_parameter_value_count(parameter);
+        memcpy(weights, parameter->values, value_count * sizeof(Int));
+        weights += value_count;
+    }
+}
+
+// NOTE: Game states built before the change keep the old material and square value sums
+Void set_eval_weights(Int *weights)
+{
+    for (Int parameter_i = 0; parameter_i < EVAL_PARAMETER_COUNT; parameter_i++)
+    {
+        EvalParameter *parameter = &eval_parameters[parameter_i];
+        Int value_count = get_eval_parameter_value_count(parameter);
+        memcpy(parameter->values, weights, value_count * sizeof(Int));
+        weights += value_count;
+    }
+    initialize_eval_tables();
+}
+
+#if defined(EVAL_TRACE)
+#define MAX_EVAL_TRACE_TERM_COUNT (512)
+
+struct EvalTraceTerm
+{
+    Int index;
+    Real64 middle;
+    Real64 end;
+};
+
+// NOTE: Coefficients are from white's side, before the phase blend and the scale of drawish endings. The value of the
+// position is the sum of weight times coefficient blended by phase and scaled, up to the rounding of eval and the fixed
+// terms.
+struct EvalTrace
+{
+    EvalTraceTerm terms[MAX_EVAL_TRACE_TERM_COUNT];
+    Int term_count;
+    Int phase;
+    Real64 scale;
+};
+
+// NOTE: Set while tracing, so only one thread can trace at a time
+EvalTrace *eval_trace;
 
-Int eval(GameState *state, GameSideEnum side)
+Void trace_eval(Int *parameter, GameSideEnum side, Real64 middle, Real64 end)
+{
+    if (!eval_trace)
+    {
+        return;
+    }
+
+    Int index = 0;
+    Int parameter_i = 0;
+    for (; parameter_i < EVAL_PARAMETER_COUNT; parameter_i++)
+    {
+        Int *values = eval_parameters[parameter_i].values;
+        Int value_count = get_eval_parameter_value_count(&eval_parameters[parameter_i]);
+        if (parameter >= values && parameter < values + value_count)
+        {
+            index += (Int)(parameter - values);
+            break;
+        }
+        index += value_count;
+    }
+    ASSERT(parameter_i < EVAL_PARAMETER_COUNT);
+    ASSERT(eval_trace->term_count < MAX_EVAL_TRACE_TERM_COUNT);
+
+    Real64 sign = side == GameSide::white ? 1 : -1;
+    EvalTraceTerm *term = &eval_trace->terms[eval_trace->term_count++];
+    term->index = index;
+    term->middle = sign * middle;
+    term->end = sign * end;
+}
+
+// NOTE: Material and square values come from the running sums in the game state, so they are traced piece by piece
+Void trace_eval_accumulators(GameState *state)
+{
+    for (GameSideEnum side = 0; side < GameSide::count; side++)
+    {
+        for (GamePieceTypeEnum piece_type = 0; piece_type < GamePieceType::count; piece_type++)
+        {
+            BitBoard occupancy = get_occupancy(state, side, piece_type);
+            while (occupancy)
+            {
+                Square square = first_set(occupancy);
+                occupancy &= occupancy - 1;
+                Square row_rel = get_row_rel(square, side);
+                Square column_rel = get_column_rel(square, side);
+                TRACE_EVAL(material_values[piece_type], side, 1, 1);
+                if (piece_type == GamePieceType::king)
+                {
+                    TRACE_EVAL(king_square_values_middle[row_rel][column_rel], side, 1, 0);
+                    TRACE_EVAL(king_square_values_end[row_rel][column_rel], side, 0, 1);
+                }
+                else
+                {
+                    TRACE_EVAL(square_values[piece_type][row_rel][column_rel], side, 1, 1);
+                }
+            }
+        }
+    }
+}
+#endif
+
+// NOTE: Pawn table is optional, without it the pawn structure is evaluated from scratch
+Int eval(GameState *state, GameSideEnum side, PawnTable *pawn_table)
 {
     Int middle = 0;
     Int end = 0;
@@ -728,8 +956,13 @@ Int eval(GameState *state, GameSideEnum side)
     Int material = materials[GameSide::white].all - materials[GameSide::black].all;
     middle += material;
     end += material;
+#if defined(EVAL_TRACE)
+    // NOTE: A pawn table hit skips the pawn structure terms
+    ASSERT(!eval_trace || !pawn_table);
+    trace_eval_accumulators(state);
+#endif
 
-    Int material_adjust = eval_material_adjust(state, GameSide::white) - eval_material_adjust(state, GameSide::black);
+    Int material_adjust = eval_material_adjust<GameSide::white>(state) - eval_material_adjust<GameSide::black>(state);
     middle += material_adjust;
     end += material_adjust;
 
@@ -737,80 +970,91 @@ Int eval(GameState *state, GameSideEnum side)
     middle += square.middle;
     end += square.end;
 
-    Int pawn_structure = eval_pawn_structure(state, GameSide::white) - eval_pawn_structure(state, GameSide::black);
+    PawnEntry local_pawn_entry;
+    PawnEntry *pawn_entry = &local_pawn_entry;
+    if (pawn_table)
+    {
+        pawn_entry = probe_pawn_table(pawn_table, state);
+    }
+    else
+    {
+        eval_pawn_entry(state, pawn_entry);
+    }
+    Int pawn_structure = pawn_entry->value;
     middle += pawn_structure;
     end += pawn_structure;
 
-    ValuePair mobility = eval_mobility(state, GameSide::white) - eval_mobility(state, GameSide::black);
+    ValuePair mobility = eval_mobility<GameSide::white>(state) - eval_mobility<GameSide::black>(state);
     middle += mobility.middle;
     end += mobility.end;
 
-    ValuePair theme = eval_theme(state, GameSide::white) - eval_theme(state, GameSide::black);
+    ValuePair theme = eval_theme<GameSide::white>(state) - eval_theme<GameSide::black>(state);
     middle += theme.middle;
     end += theme.end;
 
-    Int blockage = eval_blockage(state, GameSide::white) - eval_blockage(state, GameSide::black);
+    Int blockage = eval_blockage<GameSide::white>(state) - eval_blockage<GameSide::black>(state);
     middle += blockage;
     end += blockage;
 
-    Int attack = eval_attack(state, GameSide::white) - eval_attack(state, GameSide::black);
+    Int attack = eval_attack<GameSide::white>(state) - eval_attack<GameSide::black>(state);
     middle += attack;
     end += attack;
 
-    ValuePair safety = eval_safety(state, GameSide::white) - eval_safety(state, GameSide::black);
+    ValuePair safety = eval_safety<GameSide::white>(state) - eval_safety<GameSide::black>(state);
     middle += safety.middle;
     end += safety.end;
 
-    Int tempo = state->current_side == GameSide::white ? 10 : -10;
+    Int tempo = state->current_side == GameSide::white ? tempo_value : -tempo_value;
     middle += tempo;
     end += tempo;
+    TRACE_EVAL(tempo_value, state->current_side, 1, 1);
 
-    Int phase = 0;
-    for (GameSideEnum side = 0; side < GameSide::count; side++)
-    {
-        for (GamePieceTypeEnum piece_type = GamePieceType::knight; piece_type <= GamePieceType::queen; piece_type++)
-        {
-            BitBoard occupancy = get_occupancy(state, side, piece_type);
-            Int count = bit_count(occupancy);
-            phase += count * phase_values[piece_type];
-        }
-    }
-    phase = MIN(phase, 24);
+    Int phase = MIN(state->phase, 24);
 
     Int value = (middle * phase + end * (24 - phase)) / 24;
     GameSideEnum strong = value > 0 ? GameSide::white : GameSide::black;
     GameSideEnum weak = oppose(strong);
+    // NOTE: Scale in halves
+    Int scale = 2;
     if (materials[strong].pawn == 0)
     {
         if (materials[strong].non_pawn < 400)
         {
-            value = 0;
+            scale = 0;
         }
         else if (materials[strong].non_pawn == 2 * material_values[GamePieceType::knight] && materials[weak].pawn == 0)
         {
-            value = 0;
+            scale = 0;
         }
         else if (materials[strong].non_pawn == material_values[GamePieceType::rook] &&
                  materials[weak].non_pawn == material_values[GamePieceType::knight])
         {
-            value /= 2;
+            scale = 1;
         }
         else if (materials[strong].non_pawn == material_values[GamePieceType::rook] &&
                  materials[weak].non_pawn == material_values[GamePieceType::bishop])
         {
-            value /= 2;
+            scale = 1;
         }
         else if (materials[strong].non_pawn == material_values[GamePieceType::rook] + material_values[GamePieceType::knight] &&
                  materials[weak].non_pawn == material_values[GamePieceType::rook])
         {
-            value /= 2;
+            scale = 1;
         }
         else if (materials[strong].non_pawn == material_values[GamePieceType::rook] + material_values[GamePieceType::bishop] &&
                  materials[weak].non_pawn == material_values[GamePieceType::rook])
         {
-            value /= 2;
+            scale = 1;
         }
     }
+    value = value * scale / 2;
+#if defined(EVAL_TRACE)
+    if (eval_trace)
+    {
+        eval_trace->phase = phase;
+        eval_trace->scale = scale / 2.0;
+    }
+#endif
 
     if (side == GameSide::black)
     {
@@ -819,22 +1063,150 @@ Int eval(GameState *state, GameSideEnum side)
     return value;
 }
 
+// NOTE: Values of evaluated positions by zobrist, from the side to move. The cache is shared by all search threads without
+// locks, like the transposition table the key is stored xor-ed with the data so that an entry torn by a concurrent write
+// fails verification and counts as a miss. The high half of the data tags the eval the value was computed with, so a
+// value is never returned after the weights change or the search switches between the classical eval and the network.
+// Empty entries never match, as the tag has a bit that is always set.
+struct EvalEntry
+{
+    UInt64 key;
+    UInt64 data;
+};
+
+#define EVAL_ENTRY_TAG (1ull << 32)
+#define EVAL_ENTRY_VALUE_MASK (EVAL_ENTRY_TAG - 1)
+
+// NOTE: 2^20 entries of 16 bytes, 16 MB by default
+#define DEFAULT_EVAL_CACHE_INDEX_BIT_COUNT (20)
+#define MAX_EVAL_CACHE_INDEX_BIT_COUNT (30)
+
+struct EvalCache
+{
+    EvalEntry *entries;
+    Int index_bit_count;
+};
+
+Bool initialize_eval_cache(EvalCache *eval_cache, Int index_bit_count)
+{
+    ASSERT(index_bit_count >= 1 && index_bit_count <= MAX_EVAL_CACHE_INDEX_BIT_COUNT);
+    UInt64 memory_size = (1ull << index_bit_count) * sizeof(EvalEntry);
+    eval_cache->entries = (EvalEntry *)malloc(memory_size);
+    if (!eval_cache->entries)
+    {
+        return false;
+    }
+    memset(eval_cache->entries, 0, memory_size);
+    eval_cache->index_bit_count = index_bit_count;
+    return true;
+}
+
+UInt64 get_eval_entry_tag(Bool nnue)
+{
+    UInt64 result = EVAL_ENTRY_TAG | (UInt64)nnue << 33 | (UInt64)eval_generation << 34;
+    return result;
+}
+
+EvalEntry *get_eval_entry(EvalCache *eval_cache, UInt64 hash)
+{
+    EvalEntry *entry = &eval_cache->entries[hash >> (64 - eval_cache->index_bit_count)];
+    return entry;
+}
+
+Bool probe_eval_cache(EvalCache *eval_cache, UInt64 hash, UInt64 tag, Int *value)
+{
+    EvalEntry *entry = get_eval_entry(eval_cache, hash);
+    UInt64 key = entry->key;
+    UInt64 data = entry->data;
+    if ((key ^ data) != hash || (data & ~EVAL_ENTRY_VALUE_MASK) != tag)
+    {
+        return false;
+    }
+    *value = (Int16)data;
+    return true;
+}
+
+Void store_eval_cache(EvalCache *eval_cache, UInt64 hash, UInt64 tag, Int value)
+{
+    EvalEntry *entry = get_eval_entry(eval_cache, hash);
+    UInt64 data = tag | (UInt16)(Int16)value;
+    entry->key = hash ^ data;
+    entry->data = data;
+}
+
 struct ValuedMove
 {
     GameMove move;
     Int value;
 };
 
+namespace TableBound
+{
+enum
+{
+    none,
+    exact,
+    lower,
+    upper,
+};
+};
+typedef Int TableBoundEnum;
+
+// NOTE: TableEntry is 16 bytes so a bucket of 4 fills one cache line. Entries are shared by all search threads without locks,
+// the key is stored xor-ed with the data so that an entry torn by a concurrent write fails verification instead of being misread.
 struct TableEntry
 {
-    UInt64 hash;
+    UInt64 key;
+    UInt64 data;
+};
+
+// NOTE: TableData is packed into 64 bits
+// xxxxxx(6)  xx(2)  xxxxxxxx(8)  xxxxxxxxxxxxxxxx(16)  xxxx...(32)
+// age        bound  depth        value                 move
+struct TableData
+{
     GameMove move;
-    Int16 value;
-    Int8 depth;
+    Int value;
+    Int depth;
+    TableBoundEnum bound;
+    UInt8 age;
+};
+
+#define TABLE_AGE_MASK (0x3f)
+
+UInt64 pack_table_data(TableData *table_data)
+{
+    UInt64 data = 0;
+    data |= (UInt64)table_data->move;
+    data |= (UInt64)(UInt16)(Int16)table_data->value << 32;
+    data |= (UInt64)(UInt8)(Int8)table_data->depth << 48;
+    data |= (UInt64)(table_data->bound & 0x3) << 56;
+    data |= (UInt64)(table_data->age & TABLE_AGE_MASK) << 58;
+    return data;
+}
+
+TableData unpack_table_data(UInt64 data)
+{
+    TableData table_data;
+    table_data.move = (GameMove)data;
+    table_data.value = (Int16)(data >> 32);
+    table_data.depth = (Int8)(data >> 48);
+    table_data.bound = (data >> 56) & 0x3;
+    table_data.age = (data >> 58) & TABLE_AGE_MASK;
+    return table_data;
+}
+
+#define TABLE_BUCKET_SIZE (4)
+
+struct TableBucket
+{
+    TableEntry entries[TABLE_BUCKET_SIZE];
 };
 
-#define MAX_TABLE_MEMORY_SIZE (256ull * 1024ull * 1024ull)
-#define MAX_TABLE_SIZE (MAX_TABLE_MEMORY_SIZE / sizeof(TableEntry))
+// NOTE: 2^22 buckets of 64 bytes, 256 MB in total
+#define TABLE_INDEX_BIT_COUNT (22)
+#define MAX_TABLE_SIZE (1ull << TABLE_INDEX_BIT_COUNT)
+#define MAX_TABLE_MEMORY_SIZE (MAX_TABLE_SIZE * sizeof(TableBucket))
 
 namespace SearchState
 {
@@ -847,93 +1219,1151 @@ enum
 };
 typedef Int SearchStateEnum;
 
-struct Searcher
+#define MAX_SEARCH_THREAD_COUNT (64)
+#define MAX_SEARCH_DEPTH (64)
+
+// NOTE: Zero means no limit. With a move time or a clock the search stops starting iterations after the soft deadline
+// and aborts the running iteration at the hard deadline.
+struct SearchLimit
 {
-    SearchStateEnum search_state;
-    Void *semaphore;
+    Real64 move_time;
+    Real64 clock_time;
+    Real64 increment;
+    UInt64 node_limit;
+    Int depth_limit;
+};
+
+SearchLimit get_depth_search_limit(Int depth_limit)
+{
+    SearchLimit limit = {};
+    limit.depth_limit = depth_limit;
+    return limit;
+}
+
+SearchLimit get_move_time_search_limit(Real64 move_time)
+{
+    SearchLimit limit = {};
+    limit.move_time = move_time;
+    return limit;
+}
+
+SearchLimit get_clock_search_limit(Real64 clock_time, Real64 increment)
+{
+    SearchLimit limit = {};
+    limit.clock_time = clock_time;
+    limit.increment = increment;
+    return limit;
+}
+
+struct Searcher;
+
+// NOTE: Every search thread works on its own copy of the game state, the transposition table is the only shared data
+struct SearchThread
+{
+    Searcher *searcher;
+    Int thread_index;
+    Void *semaphore;
+
+    GameState state;
+
+    UInt64 node_count;
+    UInt64 table_hit_count;
+    UInt64 table_miss_count;
+    UInt64 table_collision_count;
+    UInt64 eval_cache_hit_count;
+    UInt64 eval_cache_miss_count;
+
+    PawnTable pawn_table;
+
+    GameMove killer_moves[MAX_SEARCH_DEPTH][2];
+    Int history_values[GameSide::count][64][64];
+    UInt64 cutoff_count;
+    UInt64 first_move_cutoff_count;
+    UInt64 quiescence_node_count;
+    UInt64 research_count;
+    UInt64 null_move_count;
+    UInt64 null_move_cutoff_count;
+    UInt64 reduction_count;
+    UInt64 reduction_research_count;
+    UInt64 see_prune_count;
+    UInt64 draw_count;
+
+    Bool null_move[MAX_SEARCH_DEPTH + 1];
+
+    // NOTE: Triangular PV table, row of each ply holds the variation from that ply on
+    GameMove pv[MAX_SEARCH_DEPTH + 1][MAX_SEARCH_DEPTH + 1];
+    Int pv_length[MAX_SEARCH_DEPTH + 1];
+};
+
+struct Searcher
+{
+    SearchStateEnum search_state;
+    Void *semaphore;
+    Void *finish_semaphore;
+    volatile Bool stop;
+
+    SearchLimit limit;
+    Bool null_move_enabled;
+    Bool late_move_reduction_enabled;
+    Bool see_pruning_enabled;
+    // NOTE: Evaluate with the loaded network instead of the classical eval, only with NNUE_EVAL
+    Bool nnue_enabled;
+    Bool eval_cache_enabled;
+    UInt64 start_timestamp;
+    Real64 soft_time;
+    Real64 hard_time;
 
     GameMove best_move;
+    Int best_value;
+    Int completed_depth;
+    Real64 search_time;
+    Real64 node_per_second;
 
     GameState *state;
-    Int depth_limit;
-    // TODO: Use transposition table
-    TableEntry *table;
+    Int thread_count;
+    SearchThread *threads;
+
+    TableBucket *table;
+    UInt8 table_age;
+    EvalCache eval_cache;
+
+    UInt64 node_count;
+    UInt64 table_hit_count;
+    UInt64 table_miss_count;
+    UInt64 table_collision_count;
+    UInt64 pawn_table_hit_count;
+    UInt64 pawn_table_miss_count;
+    UInt64 eval_cache_hit_count;
+    UInt64 eval_cache_miss_count;
+    UInt64 cutoff_count;
+    UInt64 first_move_cutoff_count;
+    UInt64 quiescence_node_count;
+    UInt64 research_count;
+    UInt64 aspiration_fail_count;
+    UInt64 null_move_count;
+    UInt64 null_move_cutoff_count;
+    UInt64 reduction_count;
+    UInt64 reduction_research_count;
+    UInt64 see_prune_count;
+    UInt64 draw_count;
+
+    GameMove pv[MAX_SEARCH_DEPTH];
+    Int pv_length;
 };
 
-Bool initialize_searcher(Searcher *searcher, GameState *state)
+Void search_helper(SearchThread *thread);
+
+Bool initialize_searcher(Searcher *searcher, GameState *state, Int thread_count)
 {
+    ASSERT(thread_count >= 1);
     searcher->search_state = SearchState::idle;
     searcher->semaphore = create_semaphore(0);
+    searcher->finish_semaphore = create_semaphore(0);
+    searcher->stop = false;
+    searcher->limit = get_depth_search_limit(4);
+    searcher->null_move_enabled = true;
+    searcher->late_move_reduction_enabled = true;
+    searcher->see_pruning_enabled = true;
+    searcher->nnue_enabled = false;
+    searcher->eval_cache_enabled = true;
     searcher->state = state;
+    if (!searcher->semaphore || !searcher->finish_semaphore)
+    {
+        return false;
+    }
+
+    searcher->table = (TableBucket *)malloc(MAX_TABLE_MEMORY_SIZE);
+    if (!searcher->table)
+    {
+        return false;
+    }
+    memset(searcher->table, 0, MAX_TABLE_MEMORY_SIZE);
+    searcher->table_age = 0;
+    if (!initialize_eval_cache(&searcher->eval_cache, DEFAULT_EVAL_CACHE_INDEX_BIT_COUNT))
+    {
+        return false;
+    }
+    searcher->node_count = 0;
+    searcher->table_hit_count = 0;
+    searcher->table_miss_count = 0;
+    searcher->table_collision_count = 0;
+    searcher->pawn_table_hit_count = 0;
+    searcher->pawn_table_miss_count = 0;
+    searcher->eval_cache_hit_count = 0;
+    searcher->eval_cache_miss_count = 0;
+    searcher->cutoff_count = 0;
+    searcher->first_move_cutoff_count = 0;
+    searcher->quiescence_node_count = 0;
+    searcher->research_count = 0;
+    searcher->aspiration_fail_count = 0;
+    searcher->null_move_count = 0;
+    searcher->null_move_cutoff_count = 0;
+    searcher->reduction_count = 0;
+    searcher->reduction_research_count = 0;
+    searcher->see_prune_count = 0;
+    searcher->draw_count = 0;
+    searcher->pv_length = 0;
+
+    searcher->thread_count = MIN(thread_count, MAX_SEARCH_THREAD_COUNT);
+    searcher->threads = (SearchThread *)malloc(searcher->thread_count * sizeof(SearchThread));
+    if (!searcher->threads)
+    {
+        return false;
+    }
+    for (Int thread_i = 0; thread_i < searcher->thread_count; thread_i++)
+    {
+        SearchThread *thread = &searcher->threads[thread_i];
+        *thread = {};
+        thread->searcher = searcher;
+        thread->thread_index = thread_i;
+        if (!initialize_pawn_table(&thread->pawn_table))
+        {
+            return false;
+        }
+        // NOTE: Thread 0 runs on the thread calling search
+        if (thread_i > 0)
+        {
+            thread->semaphore = create_semaphore(0);
+            if (!thread->semaphore || !run_thread((ThreadFunc)search_helper, thread))
+            {
+                return false;
+            }
+        }
+    }
     return true;
 }
 
+// NOTE: Only while the searcher is idle, the cache starts out empty
+Bool resize_eval_cache(Searcher *searcher, Int index_bit_count)
+{
+    free(searcher->eval_cache.entries);
+    Bool result = initialize_eval_cache(&searcher->eval_cache, index_bit_count);
+    return result;
+}
+
+TableBucket *get_table_bucket(Searcher *searcher, UInt64 hash)
+{
+    // NOTE: Zobrist keys come from an LCG whose low bits have short periods, so index with the high bits
+    TableBucket *bucket = &searcher->table[hash >> (64 - TABLE_INDEX_BIT_COUNT)];
+    return bucket;
+}
+
+Bool probe_table(SearchThread *thread, UInt64 hash, TableData *table_data)
+{
+    TableBucket *bucket = get_table_bucket(thread->searcher, hash);
+    Bool occupied = false;
+    for (Int i = 0; i < TABLE_BUCKET_SIZE; i++)
+    {
+        TableEntry *entry = &bucket->entries[i];
+        UInt64 key = entry->key;
+        UInt64 data = entry->data;
+        if (data)
+        {
+            if ((key ^ data) == hash)
+            {
+                thread->table_hit_count++;
+                *table_data = unpack_table_data(data);
+                return true;
+            }
+            occupied = true;
+        }
+    }
+
+    thread->table_miss_count++;
+    if (occupied)
+    {
+        thread->table_collision_count++;
+    }
+    return false;
+}
+
+// NOTE: Replace the same position if present, otherwise an empty slot, otherwise the shallowest entry with entries from older searches treated as shallower.
+Void store_table(SearchThread *thread, UInt64 hash, GameMove move, Int value, Int depth, TableBoundEnum bound)
+{
+    Searcher *searcher = thread->searcher;
+    TableBucket *bucket = get_table_bucket(searcher, hash);
+    UInt8 age = searcher->table_age & TABLE_AGE_MASK;
+    TableEntry *replace = null;
+    TableData replace_data = {};
+    Int replace_score = 0;
+    for (Int i = 0; i < TABLE_BUCKET_SIZE; i++)
+    {
+        TableEntry *entry = &bucket->entries[i];
+        UInt64 data = entry->data;
+        TableData entry_data = unpack_table_data(data);
+        if (!data || (entry->key ^ data) == hash)
+        {
+            replace = entry;
+            replace_data = entry_data;
+            break;
+        }
+
+        Int age_diff = (age - entry_data.age) & TABLE_AGE_MASK;
+        Int score = entry_data.depth - 8 * age_diff;
+        if (!replace || score < replace_score)
+        {
+            replace = entry;
+            replace_data = entry_data;
+            replace_score = score;
+        }
+    }
+
+    TableData table_data;
+    table_data.move = move;
+    table_data.value = value;
+    table_data.depth = depth;
+    table_data.bound = bound;
+    table_data.age = age;
+
+    // NOTE: Keep a deeper result for the same position from the current search, but still remember the new move
+    UInt64 replace_key = replace->key ^ replace->data;
+    if (replace->data && replace_key == hash && replace_data.age == age && replace_data.depth > depth && bound != TableBound::exact)
+    {
+        if (!move)
+        {
+            return;
+        }
+        table_data = replace_data;
+        table_data.move = move;
+    }
+
+    UInt64 data = pack_table_data(&table_data);
+    replace->key = hash ^ data;
+    replace->data = data;
+}
+
 #define VALUE_INF (32767)
 
-ValuedMove search_ab(Searcher *searcher, Int alpha, Int beta, Int depth)
+Void start_search_clock(Searcher *searcher)
+{
+    SearchLimit *limit = &searcher->limit;
+    searcher->start_timestamp = get_current_timestamp();
+    searcher->soft_time = 0;
+    searcher->hard_time = 0;
+    if (limit->move_time > 0)
+    {
+        searcher->soft_time = limit->move_time * 0.5;
+        searcher->hard_time = limit->move_time;
+    }
+    else if (limit->clock_time > 0)
+    {
+        // NOTE: Plan for 30 more moves, spend most of the increment, and never use more than a third of the clock
+        Real64 move_time = limit->clock_time / 30 + limit->increment * 0.8;
+        Real64 max_time = limit->clock_time / 3;
+        searcher->soft_time = MIN(move_time, max_time);
+        searcher->hard_time = MIN(move_time * 4, max_time);
+    }
+}
+
+Real64 get_search_time(Searcher *searcher)
+{
+    Real64 time = get_elapsed_time(get_current_timestamp() - searcher->start_timestamp);
+    return time;
+}
+
+// NOTE: Only the main thread checks the limits, the first iteration always completes so there is a move to play
+Void check_search_limit(SearchThread *thread)
+{
+    Searcher *searcher = thread->searcher;
+    if (searcher->completed_depth == 0)
+    {
+        return;
+    }
+
+    if (searcher->hard_time > 0 && get_search_time(searcher) >= searcher->hard_time)
+    {
+        searcher->stop = true;
+    }
+
+    if (searcher->limit.node_limit)
+    {
+        UInt64 node_count = 0;
+        for (Int thread_i = 0; thread_i < searcher->thread_count; thread_i++)
+        {
+            node_count += searcher->threads[thread_i].node_count;
+        }
+        if (node_count >= searcher->limit.node_limit)
+        {
+            searcher->stop = true;
+        }
+    }
+}
+
+#define SEARCH_LIMIT_CHECK_MASK (1023)
+
+namespace PickStage
+{
+enum
+{
+    hash,
+    capture_score,
+    capture,
+    killer,
+    quiet_score,
+    quiet,
+    bad_capture,
+    done,
+};
+};
+typedef Int PickStageEnum;
+
+// NOTE: Moves are generated all at once, the picker hands them out in stages and only scores and sorts a stage when it is
+// reached, so a cutoff on the hash move or a good capture skips the rest of the work. Captures losing material by SEE
+// are moved to the end of the list and come last.
+struct MovePicker
+{
+    Buffer<GameMove> *moves;
+    Int scores[256];
+    Int index;
+    Int stage_end;
+    Int bad_capture_begin;
+    PickStageEnum stage;
+    GameMove hash_move;
+    GameMove killer_moves[2];
+    Int killer_index;
+};
+
+Void initialize_move_picker(MovePicker *picker, SearchThread *thread, Buffer<GameMove> *moves, GameMove hash_move, Int ply)
+{
+    picker->moves = moves;
+    picker->index = 0;
+    picker->stage_end = 0;
+    picker->bad_capture_begin = moves->count;
+    picker->stage = PickStage::hash;
+    picker->hash_move = hash_move;
+    picker->killer_moves[0] = ply < MAX_SEARCH_DEPTH ? thread->killer_moves[ply][0] : 0;
+    picker->killer_moves[1] = ply < MAX_SEARCH_DEPTH ? thread->killer_moves[ply][1] : 0;
+    picker->killer_index = 0;
+}
+
+Bool is_quiet_move(GameMove move)
+{
+    Bool result = is_empty(get_captured_piece(move)) && get_move_type(move) != GameMoveType::promotion;
+    return result;
+}
+
+// NOTE: Most valuable victim first, least valuable attacker breaks ties, promotions count as winning the promoted piece
+Int get_capture_score(GameState *state, GameMove move)
+{
+    Int score = 0;
+    GamePiece captured_piece = get_captured_piece(move);
+    if (!is_empty(captured_piece))
+    {
+        score += material_values[get_piece_type(captured_piece)] * 8;
+    }
+    if (get_move_type(move) == GameMoveType::promotion)
+    {
+        score += material_values[promotion_list[get_promotion_index(move)]] * 8;
+    }
+    score -= get_piece_type(state->board[get_from(move)]);
+    return score;
+}
+
+Bool find_move(MovePicker *picker, GameMove move)
+{
+    Buffer<GameMove> &moves = *picker->moves;
+    for (Int i = picker->index; i < picker->bad_capture_begin; i++)
+    {
+        if (moves[i] == move)
+        {
+            swap(&moves[picker->index], &moves[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+GameMove pick_best_move(MovePicker *picker)
+{
+    Buffer<GameMove> &moves = *picker->moves;
+    Int best_i = picker->index;
+    for (Int i = picker->index + 1; i < picker->stage_end; i++)
+    {
+        if (picker->scores[i] > picker->scores[best_i])
+        {
+            best_i = i;
+        }
+    }
+    swap(&moves[picker->index], &moves[best_i]);
+    swap(&picker->scores[picker->index], &picker->scores[best_i]);
+    GameMove move = moves[picker->index];
+    picker->index++;
+    return move;
+}
+
+Bool next_move(MovePicker *picker, SearchThread *thread, GameMove *move)
+{
+    GameState *state = &thread->state;
+    Buffer<GameMove> &moves = *picker->moves;
+    while (true)
+    {
+        switch (picker->stage)
+        {
+        case PickStage::hash:
+        {
+            picker->stage = PickStage::capture_score;
+            // NOTE: Hash move is only used if it is among the legal moves
+            if (picker->hash_move && find_move(picker, picker->hash_move))
+            {
+                *move = moves[picker->index++];
+                return true;
+            }
+        }
+        break;
+
+        case PickStage::capture_score:
+        {
+            picker->stage_end = picker->index;
+            Int i = picker->index;
+            while (i < picker->bad_capture_begin)
+            {
+                if (is_quiet_move(moves[i]))
+                {
+                    i++;
+                    continue;
+                }
+
+                Int see = get_see(state, moves[i]);
+                if (see < 0)
+                {
+                    picker->bad_capture_begin--;
+                    swap(&moves[picker->bad_capture_begin], &moves[i]);
+                    picker->scores[picker->bad_capture_begin] = see;
+                }
+                else
+                {
+                    swap(&moves[picker->stage_end], &moves[i]);
+                    picker->scores[picker->stage_end] = get_capture_score(state, moves[picker->stage_end]);
+                    picker->stage_end++;
+                    i++;
+                }
+            }
+            picker->stage = PickStage::capture;
+        }
+        break;
+
+        case PickStage::capture:
+        {
+            if (picker->index < picker->stage_end)
+            {
+                *move = pick_best_move(picker);
+                return true;
+            }
+            picker->stage = PickStage::killer;
+        }
+        break;
+
+        case PickStage::killer:
+        {
+            while (picker->killer_index < 2)
+            {
+                GameMove killer_move = picker->killer_moves[picker->killer_index++];
+                if (killer_move && killer_move != picker->hash_move && find_move(picker, killer_move))
+                {
+                    *move = moves[picker->index++];
+                    return true;
+                }
+            }
+            picker->stage = PickStage::quiet_score;
+        }
+        break;
+
+        case PickStage::quiet_score:
+        {
+            for (Int i = picker->index; i < picker->bad_capture_begin; i++)
+            {
+                picker->scores[i] = thread->history_values[state->current_side][get_from(moves[i])][get_to(moves[i])];
+            }
+            picker->stage_end = picker->bad_capture_begin;
+            picker->stage = PickStage::quiet;
+        }
+        break;
+
+        case PickStage::quiet:
+        {
+            if (picker->index < picker->stage_end)
+            {
+                *move = pick_best_move(picker);
+                return true;
+            }
+            picker->stage_end = moves.count;
+            picker->stage = PickStage::bad_capture;
+        }
+        break;
+
+        case PickStage::bad_capture:
+        {
+            if (picker->index < picker->stage_end)
+            {
+                *move = pick_best_move(picker);
+                return true;
+            }
+            picker->stage = PickStage::done;
+        }
+        break;
+
+        default:
+        {
+            return false;
+        }
+        }
+    }
+}
+
+#define MAX_HISTORY_VALUE (1 << 20)
+
+Void update_move_order(SearchThread *thread, GameMove move, Int ply, Int depth)
 {
-    GameState *state = searcher->state;
+    if (!is_quiet_move(move))
+    {
+        return;
+    }
+
+    GameMove *killer_moves = thread->killer_moves[ply];
+    if (killer_moves[0] != move)
+    {
+        killer_moves[1] = killer_moves[0];
+        killer_moves[0] = move;
+    }
+
+    Int *history_value = &thread->history_values[thread->state.current_side][get_from(move)][get_to(move)];
+    *history_value += depth * depth;
+    if (*history_value > MAX_HISTORY_VALUE)
+    {
+        for (GameSideEnum side = 0; side < GameSide::count; side++)
+        {
+            for (Square from = 0; from < 64; from++)
+            {
+                for (Square to = 0; to < 64; to++)
+                {
+                    thread->history_values[side][from][to] /= 2;
+                }
+            }
+        }
+    }
+}
+
+// NOTE: Killers are specific to the position searched, history carries over between moves at reduced weight
+Void age_move_order(SearchThread *thread)
+{
+    memset(thread->killer_moves, 0, sizeof(thread->killer_moves));
+    for (GameSideEnum side = 0; side < GameSide::count; side++)
+    {
+        for (Square from = 0; from < 64; from++)
+        {
+            for (Square to = 0; to < 64; to++)
+            {
+                thread->history_values[side][from][to] /= 8;
+            }
+        }
+    }
+}
+
+Int eval_search(SearchThread *thread, GameState *state)
+{
+    Searcher *searcher = thread->searcher;
+    UInt64 tag = get_eval_entry_tag(searcher->nnue_enabled);
+    Int value;
+    if (searcher->eval_cache_enabled)
+    {
+        if (probe_eval_cache(&searcher->eval_cache, state->zobrist, tag, &value))
+        {
+            thread->eval_cache_hit_count++;
+            return value;
+        }
+        thread->eval_cache_miss_count++;
+    }
+
+#if defined(NNUE_EVAL)
+    if (searcher->nnue_enabled)
+    {
+        value = eval_nnue(state, &state->nnue_accumulator);
+    }
+    else
+#endif
+    {
+        value = eval(state, state->current_side, &thread->pawn_table);
+    }
+
+    if (searcher->eval_cache_enabled)
+    {
+        store_eval_cache(&searcher->eval_cache, state->zobrist, tag, value);
+    }
+    return value;
+}
+
+#define DELTA_MARGIN (200)
+
+// NOTE: Resolve captures and promotions past the horizon so that leaves are not evaluated in the middle of an exchange.
+// Side to move can stand pat on the static evaluation unless in check, where all evasions are searched instead.
+Int search_quiescence(SearchThread *thread, Int alpha, Int beta, Int ply)
+{
+    Searcher *searcher = thread->searcher;
+    GameState *state = &thread->state;
+    thread->node_count++;
+    thread->quiescence_node_count++;
+    if (thread->thread_index == 0 && (thread->node_count & SEARCH_LIMIT_CHECK_MASK) == 0)
+    {
+        check_search_limit(thread);
+    }
+    if (searcher->stop)
+    {
+        return 0;
+    }
+
+    Bool check = in_check(state, state->current_side);
+    if (!check && ply >= MAX_SEARCH_DEPTH)
+    {
+        return eval_search(thread, state);
+    }
+
     GameMove moves_data[256];
     Buffer<GameMove> moves;
     moves.count = 0;
     moves.data = moves_data;
-    generate_all_moves(searcher->state, &moves);
-    if (!moves.count)
+    Int best_value = -VALUE_INF;
+    Int stand_pat = 0;
+    if (check)
+    {
+        generate_all_moves(state, &moves);
+        if (!moves.count)
+        {
+            return -VALUE_INF;
+        }
+    }
+    else
+    {
+        stand_pat = eval_search(thread, state);
+        if (stand_pat >= beta)
+        {
+            return stand_pat;
+        }
+        best_value = stand_pat;
+        alpha = MAX(alpha, stand_pat);
+        generate_capture_moves(state, &moves);
+    }
+
+    MovePicker picker;
+    initialize_move_picker(&picker, thread, &moves, 0, ply);
+    GameMove move;
+    while (next_move(&picker, thread, &move))
+    {
+        // NOTE: Captures losing material by SEE are not searched, they are all at the end
+        if (!check && picker.stage == PickStage::bad_capture)
+        {
+            thread->see_prune_count++;
+            break;
+        }
+
+        // NOTE: Delta pruning, skip captures that cannot raise alpha even with a margin for positional gain
+        if (!check && get_move_type(move) != GameMoveType::promotion)
+        {
+            GamePiece captured_piece = get_captured_piece(move);
+            if (stand_pat + material_values[get_piece_type(captured_piece)] + DELTA_MARGIN <= alpha)
+            {
+                continue;
+            }
+        }
+
+        record_game_move(state, move);
+        Int value = -search_quiescence(thread, -beta, -alpha, ply + 1);
+        rollback_game_move(state, move);
+
+        if (value > best_value)
+        {
+            best_value = value;
+            alpha = MAX(alpha, value);
+            if (alpha >= beta)
+            {
+                break;
+            }
+        }
+    }
+    return best_value;
+}
+
+Void update_pv(SearchThread *thread, GameMove move, Int ply)
+{
+    thread->pv[ply][ply] = move;
+    for (Int pv_i = ply + 1; pv_i < thread->pv_length[ply + 1]; pv_i++)
+    {
+        thread->pv[ply][pv_i] = thread->pv[ply + 1][pv_i];
+    }
+    thread->pv_length[ply] = MAX(thread->pv_length[ply + 1], ply + 1);
+}
+
+#define NULL_MOVE_MIN_DEPTH (3)
+#define SEE_PRUNING_MAX_DEPTH (4)
+#define SEE_PRUNING_MARGIN (100)
+#define LATE_MOVE_REDUCTION_MIN_DEPTH (3)
+#define LATE_MOVE_REDUCTION_MIN_MOVE_INDEX (3)
+
+// NOTE: Principal variation search, only the first move of a node is searched with the full window, the rest are
+// proved worse with a zero window and re-searched when that fails. Depth is the remaining depth, ply the distance from
+// the root.
+ValuedMove search_ab(SearchThread *thread, Int alpha, Int beta, Int depth, Int ply)
+{
+    thread->pv_length[ply] = ply;
+    if (depth <= 0)
     {
         ValuedMove valued_move;
-        valued_move.value = in_check(state, state->current_side) ? -VALUE_INF : 0;
+        valued_move.move = 0;
+        valued_move.value = search_quiescence(thread, alpha, beta, ply);
         return valued_move;
     }
-    if (depth >= searcher->depth_limit)
+
+    Searcher *searcher = thread->searcher;
+    GameState *state = &thread->state;
+    Int original_alpha = alpha;
+    thread->node_count++;
+    if (thread->thread_index == 0 && (thread->node_count & SEARCH_LIMIT_CHECK_MASK) == 0)
+    {
+        check_search_limit(thread);
+    }
+
+    // NOTE: Once stopped the running iteration is abandoned and its result discarded
+    if (searcher->stop)
     {
         ValuedMove valued_move;
-        valued_move.value = eval(state, state->current_side);
+        valued_move.move = 0;
+        valued_move.value = 0;
         return valued_move;
     }
 
+    // NOTE: Inside the tree a single repetition is scored as a draw, the side ahead would not allow it to repeat again
+    if (ply > 0 && (is_fifty_move_draw(state) || get_repetition_count(state) > 0))
+    {
+        thread->draw_count++;
+        ValuedMove valued_move;
+        valued_move.move = 0;
+        valued_move.value = 0;
+        return valued_move;
+    }
+
+    Bool pv_node = beta - alpha > 1;
+    GameMove hash_move = 0;
+    TableData table_data;
+    if (probe_table(thread, state->zobrist, &table_data))
+    {
+        hash_move = table_data.move;
+        // NOTE: Root always searches so that a best move is produced, PV nodes search to keep the variation complete
+        if (ply > 0 && !pv_node && table_data.depth >= depth)
+        {
+            Int value = table_data.value;
+            if (table_data.bound == TableBound::exact ||
+                (table_data.bound == TableBound::lower && value >= beta) ||
+                (table_data.bound == TableBound::upper && value <= alpha))
+            {
+                ValuedMove valued_move;
+                valued_move.move = table_data.move;
+                valued_move.value = value;
+                return valued_move;
+            }
+        }
+    }
+
+    // NOTE: Null move pruning, if passing still fails high with a reduced search the node is very likely to fail high.
+    // Not done in check, twice in a row, or without non pawn material where zugzwang makes passing an advantage.
+    Bool check = in_check(state, state->current_side);
+    thread->null_move[ply] = false;
+    if (searcher->null_move_enabled && !pv_node && !check && depth >= NULL_MOVE_MIN_DEPTH &&
+        !(ply > 0 && thread->null_move[ply - 1]) && eval_material(state, state->current_side).non_pawn > 0)
+    {
+        Int reduction = 2 + depth / 4;
+        thread->null_move_count++;
+        thread->null_move[ply] = true;
+        Square en_passant = record_null_move(state);
+        Int value = -search_ab(thread, -beta, -beta + 1, depth - 1 - reduction, ply + 1).value;
+        rollback_null_move(state, en_passant);
+        thread->null_move[ply] = false;
+        if (searcher->stop)
+        {
+            ValuedMove valued_move;
+            valued_move.move = 0;
+            valued_move.value = 0;
+            return valued_move;
+        }
+        if (value >= beta)
+        {
+            thread->null_move_cutoff_count++;
+            ValuedMove valued_move;
+            valued_move.move = 0;
+            valued_move.value = value >= VALUE_INF ? beta : value;
+            return valued_move;
+        }
+    }
+
+    GameMove moves_data[256];
+    Buffer<GameMove> moves;
+    moves.count = 0;
+    moves.data = moves_data;
+    generate_all_moves(state, &moves);
+    if (!moves.count)
+    {
+        ValuedMove valued_move;
+        valued_move.move = 0;
+        valued_move.value = check ? -VALUE_INF : 0;
+        return valued_move;
+    }
+
+    MovePicker picker;
+    initialize_move_picker(&picker, thread, &moves, hash_move, ply);
+
     ValuedMove best_move;
+    best_move.move = 0;
     best_move.value = -VALUE_INF;
-    for (Int i = 0; i < moves.count; i++)
+    GameMove move;
+    // NOTE: Moves skipped by SEE pruning are not counted, the first move and the late move threshold go by moves searched
+    Int searched_move_count = 0;
+    while (next_move(&picker, thread, &move))
     {
-        GameMove move = moves[i];
+        // NOTE: Near the leaves, skip captures losing more by SEE than the remaining depth could make up
+        if (searcher->see_pruning_enabled && !pv_node && !check && best_move.move && depth <= SEE_PRUNING_MAX_DEPTH &&
+            picker.stage == PickStage::bad_capture && picker.scores[picker.index - 1] < -SEE_PRUNING_MARGIN * depth)
+        {
+            thread->see_prune_count++;
+            continue;
+        }
+
+        Int move_i = searched_move_count++;
         record_game_move(state, move);
-        ValuedMove valued_move = search_ab(searcher, -beta, -alpha, depth + 1);
-        valued_move.value = -valued_move.value;
+        Int value;
+        if (move_i == 0)
+        {
+            value = -search_ab(thread, -beta, -alpha, depth - 1, ply + 1).value;
+        }
+        else
+        {
+            // NOTE: Late move reductions, quiet moves that come after the hash move, captures and killers are searched
+            // shallower and only searched again at full depth if they beat alpha
+            Int reduction = 0;
+            if (searcher->late_move_reduction_enabled && depth >= LATE_MOVE_REDUCTION_MIN_DEPTH &&
+                move_i >= LATE_MOVE_REDUCTION_MIN_MOVE_INDEX && picker.stage == PickStage::quiet && !check &&
+                !in_check(state, state->current_side))
+            {
+                reduction = move_i >= 2 * LATE_MOVE_REDUCTION_MIN_MOVE_INDEX && !pv_node ? 2 : 1;
+                reduction = MIN(reduction, depth - 1);
+                thread->reduction_count++;
+            }
+
+            value = -search_ab(thread, -alpha - 1, -alpha, depth - 1 - reduction, ply + 1).value;
+            if (reduction && value > alpha)
+            {
+                thread->reduction_research_count++;
+                value = -search_ab(thread, -alpha - 1, -alpha, depth - 1, ply + 1).value;
+            }
+            if (value > alpha && value < beta)
+            {
+                thread->research_count++;
+                value = -search_ab(thread, -beta, -alpha, depth - 1, ply + 1).value;
+            }
+        }
         rollback_game_move(state, move);
 
-        if (valued_move.value > best_move.value)
+        if (value > best_move.value || !best_move.move)
         {
-            best_move.value = valued_move.value;
+            best_move.value = value;
             best_move.move = move;
 
-            alpha = MAX(alpha, best_move.value);
-            if (alpha >= beta)
+            if (value > alpha)
             {
-                break;
+                alpha = value;
+                update_pv(thread, move, ply);
+                if (alpha >= beta)
+                {
+                    thread->cutoff_count++;
+                    if (move_i == 0)
+                    {
+                        thread->first_move_cutoff_count++;
+                    }
+                    update_move_order(thread, move, ply, depth);
+                    break;
+                }
             }
         }
     }
+
+    if (searcher->stop)
+    {
+        return best_move;
+    }
+    TableBoundEnum bound = best_move.value >= beta ? TableBound::lower : best_move.value <= original_alpha ? TableBound::upper : TableBound::exact;
+    store_table(thread, state->zobrist, best_move.move, best_move.value, depth, bound);
     return best_move;
 }
 
+// NOTE: Helper threads run the same iterative deepening, odd threads one ply deeper, to fill the shared table for the main thread
+Void search_helper(SearchThread *thread)
+{
+    Searcher *searcher = thread->searcher;
+    while (true)
+    {
+        ASSERT(down_semaphore(thread->semaphore));
+
+        for (Int depth_limit = 1 + (thread->thread_index & 1); !searcher->stop && depth_limit <= MAX_SEARCH_DEPTH; depth_limit++)
+        {
+            search_ab(thread, -VALUE_INF, VALUE_INF, depth_limit, 0);
+        }
+        ASSERT(up_semaphore(searcher->finish_semaphore, 1));
+    }
+}
+
+#define ASPIRATION_WINDOW (25)
+#define ASPIRATION_MIN_DEPTH (4)
+
 Void search(Searcher *searcher)
 {
     while (true)
     {
         ASSERT(down_semaphore(searcher->semaphore));
+        searcher->table_age++;
+        searcher->stop = false;
+        searcher->completed_depth = 0;
+        searcher->aspiration_fail_count = 0;
+        searcher->pv_length = 0;
+        start_search_clock(searcher);
+
+        for (Int thread_i = 0; thread_i < searcher->thread_count; thread_i++)
+        {
+            SearchThread *thread = &searcher->threads[thread_i];
+            thread->state = *searcher->state;
+            thread->node_count = 0;
+            thread->table_hit_count = 0;
+            thread->table_miss_count = 0;
+            thread->table_collision_count = 0;
+            thread->pawn_table.hit_count = 0;
+            thread->pawn_table.miss_count = 0;
+            thread->eval_cache_hit_count = 0;
+            thread->eval_cache_miss_count = 0;
+            thread->cutoff_count = 0;
+            thread->first_move_cutoff_count = 0;
+            thread->quiescence_node_count = 0;
+            thread->research_count = 0;
+            thread->null_move_count = 0;
+            thread->null_move_cutoff_count = 0;
+            thread->reduction_count = 0;
+            thread->reduction_research_count = 0;
+            thread->see_prune_count = 0;
+            thread->draw_count = 0;
+            age_move_order(thread);
+            if (thread_i > 0)
+            {
+                ASSERT(up_semaphore(thread->semaphore, 1));
+            }
+        }
 
+        SearchThread *main_thread = &searcher->threads[0];
+        Int max_depth = searcher->limit.depth_limit > 0 ? MIN(searcher->limit.depth_limit, MAX_SEARCH_DEPTH) : MAX_SEARCH_DEPTH;
         ValuedMove best_move;
+        best_move.move = 0;
         best_move.value = -VALUE_INF;
-        for (Int depth_limit = 1; depth_limit <= 4; depth_limit++)
+        for (Int depth_limit = 1; depth_limit <= max_depth; depth_limit++)
         {
-            searcher->depth_limit = depth_limit;
-            ValuedMove valued_move = search_ab(searcher, -VALUE_INF, VALUE_INF, 0);
-            if (valued_move.value > best_move.value)
+            // NOTE: Next iteration is unlikely to finish after the soft deadline
+            if (searcher->completed_depth > 0 && searcher->soft_time > 0 && get_search_time(searcher) >= searcher->soft_time)
+            {
+                break;
+            }
+
+            // NOTE: Aspiration window around the previous score, widened on the failing side until the score falls inside
+            Int window = ASPIRATION_WINDOW;
+            Int alpha = -VALUE_INF;
+            Int beta = VALUE_INF;
+            if (depth_limit >= ASPIRATION_MIN_DEPTH && ABS(best_move.value) < VALUE_INF)
+            {
+                alpha = MAX(best_move.value - window, -VALUE_INF);
+                beta = MIN(best_move.value + window, VALUE_INF);
+            }
+
+            ValuedMove valued_move;
+            while (true)
+            {
+                valued_move = search_ab(main_thread, alpha, beta, depth_limit, 0);
+                if (searcher->stop)
+                {
+                    break;
+                }
+
+                if (valued_move.value <= alpha && alpha > -VALUE_INF)
+                {
+                    alpha = MAX(valued_move.value - window, -VALUE_INF);
+                }
+                else if (valued_move.value >= beta && beta < VALUE_INF)
+                {
+                    beta = MIN(valued_move.value + window, VALUE_INF);
+                }
+                else
+                {
+                    break;
+                }
+                window *= 2;
+                searcher->aspiration_fail_count++;
+            }
+            if (searcher->stop)
+            {
+                break;
+            }
+
+            best_move = valued_move;
+            searcher->completed_depth = depth_limit;
+            searcher->pv_length = main_thread->pv_length[0];
+            memcpy(searcher->pv, main_thread->pv[0], searcher->pv_length * sizeof(GameMove));
+            if (ABS(best_move.value) == VALUE_INF)
             {
-                best_move = valued_move;
+                break;
             }
         }
+
+        searcher->stop = true;
+        for (Int thread_i = 1; thread_i < searcher->thread_count; thread_i++)
+        {
+            ASSERT(down_semaphore(searcher->finish_semaphore));
+        }
+
+        searcher->node_count = 0;
+        searcher->table_hit_count = 0;
+        searcher->table_miss_count = 0;
+        searcher->table_collision_count = 0;
+        searcher->pawn_table_hit_count = 0;
+        searcher->pawn_table_miss_count = 0;
+        searcher->eval_cache_hit_count = 0;
+        searcher->eval_cache_miss_count = 0;
+        searcher->cutoff_count = 0;
+        searcher->first_move_cutoff_count = 0;
+        searcher->quiescence_node_count = 0;
+        searcher->research_count = 0;
+        searcher->null_move_count = 0;
+        searcher->null_move_cutoff_count = 0;
+        searcher->reduction_count = 0;
+        searcher->reduction_research_count = 0;
+        searcher->see_prune_count = 0;
+        searcher->draw_count = 0;
+        for (Int thread_i = 0; thread_i < searcher->thread_count; thread_i++)
+        {
+            SearchThread *thread = &searcher->threads[thread_i];
+            searcher->node_count += thread->node_count;
+            searcher->table_hit_count += thread->table_hit_count;
+            searcher->table_miss_count += thread->table_miss_count;
+            searcher->table_collision_count += thread->table_collision_count;
+            searcher->pawn_table_hit_count += thread->pawn_table.hit_count;
+            searcher->pawn_table_miss_count += thread->pawn_table.miss_count;
+            searcher->eval_cache_hit_count += thread->eval_cache_hit_count;
+            searcher->eval_cache_miss_count += thread->eval_cache_miss_count;
+            searcher->cutoff_count += thread->cutoff_count;
+            searcher->first_move_cutoff_count += thread->first_move_cutoff_count;
+            searcher->quiescence_node_count += thread->quiescence_node_count;
+            searcher->research_count += thread->research_count;
+            searcher->null_move_count += thread->null_move_count;
+            searcher->null_move_cutoff_count += thread->null_move_cutoff_count;
+            searcher->reduction_count += thread->reduction_count;
+            searcher->reduction_research_count += thread->reduction_research_count;
+            searcher->see_prune_count += thread->see_prune_count;
+            searcher->draw_count += thread->draw_count;
+        }
         searcher->best_move = best_move.move;
+        searcher->best_value = best_move.value;
+        searcher->search_time = get_search_time(searcher);
+        searcher->node_per_second = searcher->search_time > 0 ? searcher->node_count / searcher->search_time : 0;
         searcher->search_state = SearchState::finished;
     }
 }
@@ -0,0 +1,4 @@
+clang-cl /W4 /Zi -O2 /EHa -mpopcnt -mbmi -mlzcnt -o bin/tune.exe `
+    -Wno-logical-op-parentheses -Wno-switch -Wno-unused-label -Wno-unused-parameter -Wno-missing-field-initializers -Wno-missing-braces -Wno-writable-strings -Wno-deprecated-declarations `
+    tune/main.cpp `
+    /link /NATVIS:misc/debug.natvis user32.lib
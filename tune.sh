@@ -0,0 +1,6 @@
+#!/bin/sh
+set -e
+mkdir -p bin
+FLAGS="-std=c++14 -O2 -g -Wall -Wno-switch -Wno-unused-label -Wno-unused-parameter -Wno-missing-field-initializers -Wno-missing-braces -Wno-write-strings -Wno-deprecated-declarations"
+
+${CXX:-clang++} $FLAGS -mpopcnt -mbmi -mlzcnt tune/main.cpp -o bin/tune -lpthread -ldl
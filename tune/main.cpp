@@ -0,0 +1,695 @@
+#define EVAL_TRACE
+
+#include <cmath>
+
+#include "../lib/util.hpp"
+#include "../lib/os.hpp"
+#include "../src/game.cpp"
+#include "../src/search.cpp"
+
+// NOTE: The value of a position is the offset plus the coefficients dotted with the weights. The offset takes the fixed
+// terms and the rounding of eval, so with the starting weights the value is exactly what eval returns.
+struct TunePosition
+{
+    Int fen_offset;
+    Int fen_count;
+    Int64 term_offset;
+    Int term_count;
+    Real32 result;
+    Real32 offset;
+};
+
+struct TuneTerm
+{
+    Int index;
+    Real32 coefficient;
+};
+
+namespace TuneJob
+{
+enum
+{
+    linear_loss,
+    gradient,
+    eval_loss,
+};
+};
+typedef Int TuneJobEnum;
+
+#define MAX_TUNE_THREAD_COUNT (64)
+
+struct Tuner;
+
+struct TuneWorker
+{
+    Tuner *tuner;
+    Void *semaphore;
+    Int position_begin;
+    Int position_end;
+    GameState *state;
+    Real64 loss;
+    Real64 *gradient;
+};
+
+struct Tuner
+{
+    Str file_contents;
+    Array<TunePosition> positions;
+    // NOTE: Tens of millions of positions take more terms than an Array can count, so they are grown here with realloc
+    TuneTerm *terms;
+    Int64 term_count;
+    Int64 term_capacity;
+    Int weight_count;
+    Real64 *weights;
+    Real64 *gradient;
+    Bool *weight_used;
+    Real64 k;
+
+    TuneJobEnum job;
+    Void *finish_semaphore;
+    Int thread_count;
+    TuneWorker workers[MAX_TUNE_THREAD_COUNT];
+};
+
+Bool match_str(Str line, Int pos, CStr text)
+{
+    Int count = (Int)strlen(text);
+    Bool result = pos + count <= line.count && memcmp(&line.data[pos], text, count) == 0;
+    return result;
+}
+
+// NOTE: The result is taken from after the four position fields, either c9 style as 1-0, 0-1 and 1/2-1/2 or as a white
+// score in brackets like [1.0], [0.5] and [0.0]
+Bool get_tune_result(Str line, Real32 *result)
+{
+    Int pos = 0;
+    for (Int field_i = 0; field_i < 4; field_i++)
+    {
+        while (pos < line.count && line[pos] != ' ')
+        {
+            pos++;
+        }
+        while (pos < line.count && line[pos] == ' ')
+        {
+            pos++;
+        }
+    }
+
+    for (; pos < line.count; pos++)
+    {
+        if (match_str(line, pos, "1/2-1/2"))
+        {
+            *result = 0.5f;
+            return true;
+        }
+        else if (match_str(line, pos, "1-0"))
+        {
+            *result = 1;
+            return true;
+        }
+        else if (match_str(line, pos, "0-1"))
+        {
+            *result = 0;
+            return true;
+        }
+        else if (line[pos] == '[')
+        {
+            char number[16] = {};
+            for (Int i = 0; i < 15 && pos + 1 + i < line.count && line[pos + 1 + i] != ']'; i++)
+            {
+                number[i] = line[pos + 1 + i];
+            }
+            *result = (Real32)atof(number);
+            return *result >= 0 && *result <= 1;
+        }
+    }
+    return false;
+}
+
+#define INITIAL_TUNE_TERM_CAPACITY (1 << 16)
+
+TuneTerm *push_tune_term(Tuner *tuner)
+{
+    if (tuner->term_count == tuner->term_capacity)
+    {
+        TuneTerm *terms = (TuneTerm *)realloc(tuner->terms, tuner->term_capacity * 2 * sizeof(TuneTerm));
+        if (!terms)
+        {
+            return NULL;
+        }
+        tuner->terms = terms;
+        tuner->term_capacity *= 2;
+    }
+    TuneTerm *result = &tuner->terms[tuner->term_count++];
+    return result;
+}
+
+// NOTE: Parses and traces every line of the file on this thread, as only one thread can trace at a time. Lines without a
+// valid position and result are skipped.
+Bool load_tune_positions(Tuner *tuner, CStr filename, Int *skip_count)
+{
+    if (!map_file(filename, &tuner->file_contents))
+    {
+        return false;
+    }
+    Str contents = tuner->file_contents;
+
+    Int line_count = 1;
+    for (Int i = 0; i < contents.count; i++)
+    {
+        line_count += contents[i] == '\n';
+    }
+    tuner->positions = create_array<TunePosition>(line_count);
+    tuner->term_count = 0;
+    tuner->term_capacity = INITIAL_TUNE_TERM_CAPACITY;
+    tuner->terms = (TuneTerm *)malloc(tuner->term_capacity * sizeof(TuneTerm));
+    if (!tuner->terms)
+    {
+        return false;
+    }
+
+    tuner->weight_count = get_eval_weight_count();
+    Int *weights = (Int *)malloc(tuner->weight_count * sizeof(Int));
+    get_eval_weights(weights);
+    tuner->weights = (Real64 *)malloc(tuner->weight_count * sizeof(Real64));
+    tuner->gradient = (Real64 *)malloc(tuner->weight_count * sizeof(Real64));
+    tuner->weight_used = (Bool *)malloc(tuner->weight_count * sizeof(Bool));
+    for (Int weight_i = 0; weight_i < tuner->weight_count; weight_i++)
+    {
+        tuner->weights[weight_i] = weights[weight_i];
+        tuner->weight_used[weight_i] = false;
+    }
+
+    // NOTE: Parameters are traced once per use, the coefficients are summed per weight before they are stored
+    Real64 *coefficients = (Real64 *)malloc(tuner->weight_count * sizeof(Real64));
+    Bool *coefficient_used = (Bool *)malloc(tuner->weight_count * sizeof(Bool));
+    Int *coefficient_indices = (Int *)malloc(tuner->weight_count * sizeof(Int));
+    for (Int weight_i = 0; weight_i < tuner->weight_count; weight_i++)
+    {
+        coefficients[weight_i] = 0;
+        coefficient_used[weight_i] = false;
+    }
+
+    GameState *state = (GameState *)malloc(sizeof(GameState));
+    EvalTrace *trace = (EvalTrace *)malloc(sizeof(EvalTrace));
+    *skip_count = 0;
+    Bool result = true;
+    Int line_begin = 0;
+    while (result && line_begin < contents.count)
+    {
+        Int line_end = line_begin;
+        while (line_end < contents.count && contents[line_end] != '\n')
+        {
+            line_end++;
+        }
+        Str line;
+        line.data = &contents.data[line_begin];
+        line.count = line_end - line_begin;
+        while (line.count > 0 && (line[line.count - 1] == '\r' || line[line.count - 1] == ' '))
+        {
+            line.count--;
+        }
+
+        Real32 line_result;
+        if (line.count == 0)
+        {
+        }
+        else if (!get_game_state_from_fen(GameSide::white, line, state) || !get_tune_result(line, &line_result))
+        {
+            (*skip_count)++;
+        }
+        else
+        {
+            trace->term_count = 0;
+            eval_trace = trace;
+            Int value = eval(state, GameSide::white, NULL);
+            eval_trace = NULL;
+
+            Int coefficient_count = 0;
+            for (Int term_i = 0; term_i < trace->term_count; term_i++)
+            {
+                EvalTraceTerm *term = &trace->terms[term_i];
+                if (!coefficient_used[term->index])
+                {
+                    coefficient_used[term->index] = true;
+                    coefficient_indices[coefficient_count++] = term->index;
+                }
+                coefficients[term->index] += (term->middle * trace->phase + term->end * (24 - trace->phase)) / 24 * trace->scale;
+            }
+
+            TunePosition *position = tuner->positions.push();
+            position->fen_offset = line_begin;
+            position->fen_count = line.count;
+            position->term_offset = tuner->term_count;
+            position->term_count = 0;
+            position->result = line_result;
+            Real64 linear_value = 0;
+            for (Int coefficient_i = 0; coefficient_i < coefficient_count; coefficient_i++)
+            {
+                Int index = coefficient_indices[coefficient_i];
+                Real32 coefficient = (Real32)coefficients[index];
+                coefficients[index] = 0;
+                coefficient_used[index] = false;
+                if (coefficient != 0)
+                {
+                    TuneTerm *term = push_tune_term(tuner);
+                    if (!term)
+                    {
+                        result = false;
+                        break;
+                    }
+                    term->index = index;
+                    term->coefficient = coefficient;
+                    position->term_count++;
+                    linear_value += tuner->weights[index] * coefficient;
+                    tuner->weight_used[index] = true;
+                }
+            }
+            position->offset = (Real32)(value - linear_value);
+        }
+        line_begin = line_end + 1;
+    }
+
+    free(trace);
+    free(state);
+    free(coefficient_indices);
+    free(coefficient_used);
+    free(coefficients);
+    free(weights);
+    return result;
+}
+
+Real64 get_tune_sigmoid(Real64 k, Real64 value)
+{
+    Real64 result = 1 / (1 + pow(10, -k * value / 400));
+    return result;
+}
+
+Real64 get_linear_value(Tuner *tuner, TunePosition *position)
+{
+    Real64 value = position->offset;
+    TuneTerm *terms = &tuner->terms[position->term_offset];
+    for (Int term_i = 0; term_i < position->term_count; term_i++)
+    {
+        value += tuner->weights[terms[term_i].index] * terms[term_i].coefficient;
+    }
+    return value;
+}
+
+Void run_tune_worker(TuneWorker *worker)
+{
+    Tuner *tuner = worker->tuner;
+    while (true)
+    {
+        ASSERT(down_semaphore(worker->semaphore));
+        worker->loss = 0;
+        switch (tuner->job)
+        {
+        case TuneJob::linear_loss:
+        {
+            for (Int position_i = worker->position_begin; position_i < worker->position_end; position_i++)
+            {
+                TunePosition *position = &tuner->positions.data[position_i];
+                Real64 error = position->result - get_tune_sigmoid(tuner->k, get_linear_value(tuner, position));
+                worker->loss += error * error;
+            }
+        }
+        break;
+
+        case TuneJob::gradient:
+        {
+            for (Int weight_i = 0; weight_i < tuner->weight_count; weight_i++)
+            {
+                worker->gradient[weight_i] = 0;
+            }
+            for (Int position_i = worker->position_begin; position_i < worker->position_end; position_i++)
+            {
+                TunePosition *position = &tuner->positions.data[position_i];
+                Real64 sigmoid = get_tune_sigmoid(tuner->k, get_linear_value(tuner, position));
+                Real64 error = sigmoid - position->result;
+                worker->loss += error * error;
+
+                Real64 slope = error * sigmoid * (1 - sigmoid);
+                TuneTerm *terms = &tuner->terms[position->term_offset];
+                for (Int term_i = 0; term_i < position->term_count; term_i++)
+                {
+                    worker->gradient[terms[term_i].index] += slope * terms[term_i].coefficient;
+                }
+            }
+        }
+        break;
+
+        case TuneJob::eval_loss:
+        {
+            for (Int position_i = worker->position_begin; position_i < worker->position_end; position_i++)
+            {
+                TunePosition *position = &tuner->positions.data[position_i];
+                Str fen;
+                fen.data = &tuner->file_contents.data[position->fen_offset];
+                fen.count = position->fen_count;
+                ASSERT(get_game_state_from_fen(GameSide::white, fen, worker->state));
+                Real64 error = position->result - get_tune_sigmoid(tuner->k, eval(worker->state, GameSide::white, NULL));
+                worker->loss += error * error;
+            }
+        }
+        break;
+        }
+        ASSERT(up_semaphore(tuner->finish_semaphore, 1));
+    }
+}
+
+Bool initialize_tune_workers(Tuner *tuner, Int thread_count)
+{
+    tuner->finish_semaphore = create_semaphore(0);
+    if (!tuner->finish_semaphore)
+    {
+        return false;
+    }
+
+    tuner->thread_count = thread_count;
+    Int position_count = tuner->positions.count;
+    for (Int thread_i = 0; thread_i < thread_count; thread_i++)
+    {
+        TuneWorker *worker = &tuner->workers[thread_i];
+        worker->tuner = tuner;
+        worker->semaphore = create_semaphore(0);
+        worker->position_begin = (Int)((Int64)position_count * thread_i / thread_count);
+        worker->position_end = (Int)((Int64)position_count * (thread_i + 1) / thread_count);
+        worker->state = (GameState *)malloc(sizeof(GameState));
+        worker->gradient = (Real64 *)malloc(tuner->weight_count * sizeof(Real64));
+        if (!worker->semaphore || !worker->state || !worker->gradient || !run_thread((ThreadFunc)run_tune_worker, worker))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// NOTE: Mean squared error over all positions, the gradient job also leaves the gradient of the mean in tuner->gradient
+Real64 run_tune_job(Tuner *tuner, TuneJobEnum job)
+{
+    tuner->job = job;
+    for (Int thread_i = 0; thread_i < tuner->thread_count; thread_i++)
+    {
+        ASSERT(up_semaphore(tuner->workers[thread_i].semaphore, 1));
+    }
+    for (Int thread_i = 0; thread_i < tuner->thread_count; thread_i++)
+    {
+        ASSERT(down_semaphore(tuner->finish_semaphore));
+    }
+
+    Real64 loss = 0;
+    for (Int thread_i = 0; thread_i < tuner->thread_count; thread_i++)
+    {
+        loss += tuner->workers[thread_i].loss;
+    }
+    loss /= tuner->positions.count;
+
+    if (job == TuneJob::gradient)
+    {
+        Real64 scale = 2 * tuner->k * log(10.0) / 400 / tuner->positions.count;
+        for (Int weight_i = 0; weight_i < tuner->weight_count; weight_i++)
+        {
+            Real64 gradient = 0;
+            for (Int thread_i = 0; thread_i < tuner->thread_count; thread_i++)
+            {
+                gradient += tuner->workers[thread_i].gradient[weight_i];
+            }
+            tuner->gradient[weight_i] = gradient * scale;
+        }
+    }
+    return loss;
+}
+
+// NOTE: K maps values to the expected score, it is fitted once for the starting weights and then kept
+Void fit_tune_k(Tuner *tuner)
+{
+    Real64 ratio = (sqrt(5.0) - 1) / 2;
+    Real64 low = 0;
+    Real64 high = 4;
+    for (Int iteration = 0; iteration < 48; iteration++)
+    {
+        Real64 k0 = high - ratio * (high - low);
+        Real64 k1 = low + ratio * (high - low);
+        tuner->k = k0;
+        Real64 loss0 = run_tune_job(tuner, TuneJob::linear_loss);
+        tuner->k = k1;
+        Real64 loss1 = run_tune_job(tuner, TuneJob::linear_loss);
+        if (loss0 < loss1)
+        {
+            high = k1;
+        }
+        else
+        {
+            low = k0;
+        }
+    }
+    tuner->k = (low + high) / 2;
+}
+
+#define ADAM_LEARNING_RATE (1.0)
+#define ADAM_BETA1 (0.9)
+#define ADAM_BETA2 (0.999)
+#define ADAM_EPSILON (1e-12)
+#define TUNE_REPORT_INTERVAL (50)
+
+Void run_adam(Tuner *tuner, Int iteration_count)
+{
+    Real64 *moment = (Real64 *)malloc(tuner->weight_count * sizeof(Real64));
+    Real64 *velocity = (Real64 *)malloc(tuner->weight_count * sizeof(Real64));
+    for (Int weight_i = 0; weight_i < tuner->weight_count; weight_i++)
+    {
+        moment[weight_i] = 0;
+        velocity[weight_i] = 0;
+    }
+
+    UInt64 timestamp = get_current_timestamp();
+    Real64 beta1_power = 1;
+    Real64 beta2_power = 1;
+    for (Int iteration = 1; iteration <= iteration_count; iteration++)
+    {
+        Real64 loss = run_tune_job(tuner, TuneJob::gradient);
+        beta1_power *= ADAM_BETA1;
+        beta2_power *= ADAM_BETA2;
+        for (Int weight_i = 0; weight_i < tuner->weight_count; weight_i++)
+        {
+            Real64 gradient = tuner->gradient[weight_i];
+            moment[weight_i] = ADAM_BETA1 * moment[weight_i] + (1 - ADAM_BETA1) * gradient;
+            velocity[weight_i] = ADAM_BETA2 * velocity[weight_i] + (1 - ADAM_BETA2) * gradient * gradient;
+            Real64 moment_hat = moment[weight_i] / (1 - beta1_power);
+            Real64 velocity_hat = velocity[weight_i] / (1 - beta2_power);
+            tuner->weights[weight_i] -= ADAM_LEARNING_RATE * moment_hat / (sqrt(velocity_hat) + ADAM_EPSILON);
+        }
+
+        if (iteration % TUNE_REPORT_INTERVAL == 0 || iteration == iteration_count)
+        {
+            printf("iteration %5d  loss %.6f  time %.1fs\n", iteration, loss, get_elapsed_time(get_current_timestamp() - timestamp));
+        }
+    }
+
+    free(velocity);
+    free(moment);
+}
+
+// NOTE: Texel's local search on whole numbers, every weight that some position uses moves one step either way as long as
+// the loss improves. Each step is a pass over all positions, so this is for refining or for small data sets.
+Void run_local_search(Tuner *tuner, Int iteration_count)
+{
+    for (Int weight_i = 0; weight_i < tuner->weight_count; weight_i++)
+    {
+        tuner->weights[weight_i] = round(tuner->weights[weight_i]);
+    }
+
+    UInt64 timestamp = get_current_timestamp();
+    Real64 best_loss = run_tune_job(tuner, TuneJob::linear_loss);
+    for (Int iteration = 1; iteration <= iteration_count; iteration++)
+    {
+        Int change_count = 0;
+        for (Int weight_i = 0; weight_i < tuner->weight_count; weight_i++)
+        {
+            if (!tuner->weight_used[weight_i])
+            {
+                continue;
+            }
+
+            Real64 steps[2] = {1, -2};
+            Bool improved = false;
+            for (Int step_i = 0; step_i < 2 && !improved; step_i++)
+            {
+                tuner->weights[weight_i] += steps[step_i];
+                Real64 loss = run_tune_job(tuner, TuneJob::linear_loss);
+                if (loss < best_loss)
+                {
+                    best_loss = loss;
+                    improved = true;
+                    change_count++;
+                }
+            }
+            if (!improved)
+            {
+                tuner->weights[weight_i] += 1;
+            }
+        }
+
+        printf("iteration %5d  loss %.6f  changes %d  time %.1fs\n", iteration, best_loss, change_count, get_elapsed_time(get_current_timestamp() - timestamp));
+        if (change_count == 0)
+        {
+            break;
+        }
+    }
+}
+
+Void print_eval_parameter(EvalParameter *parameter, Int *weights)
+{
+    if (get_eval_parameter_value_count(parameter) == 1)
+    {
+        printf("Int %s = %d;\n\n", parameter->name, weights[0]);
+        return;
+    }
+
+    if (parameter->table_count > 1)
+    {
+        printf("Int %s[%d][%d][%d] = {\n", parameter->name, parameter->table_count, parameter->row_count, parameter->column_count);
+    }
+    else if (parameter->row_count > 1)
+    {
+        printf("Int %s[%d][%d] = {\n", parameter->name, parameter->row_count, parameter->column_count);
+    }
+    else
+    {
+        printf("Int %s[%d] = {", parameter->name, parameter->column_count);
+    }
+
+    for (Int table_i = 0; table_i < parameter->table_count; table_i++)
+    {
+        if (parameter->table_count > 1)
+        {
+            printf("    {\n");
+        }
+        for (Int row_i = 0; row_i < parameter->row_count; row_i++)
+        {
+            if (parameter->row_count > 1)
+            {
+                printf(parameter->table_count > 1 ? "        {" : "    {");
+            }
+            for (Int column_i = 0; column_i < parameter->column_count; column_i++)
+            {
+                if (column_i > 0)
+                {
+                    printf(column_i % 10 == 0 ? ",\n    " : ", ");
+                }
+                printf("%d", *weights++);
+            }
+            if (parameter->row_count > 1)
+            {
+                printf("},\n");
+            }
+        }
+        if (parameter->table_count > 1)
+        {
+            printf("    },\n");
+        }
+    }
+    printf("};\n\n");
+}
+
+Void print_usage()
+{
+    printf("usage: tune adam <epd file> [iteration count] [thread count]\n");
+    printf("       tune local <epd file> [iteration count] [thread count]\n");
+}
+
+int main(Int argc, CStr *argv)
+{
+    argc--, argv++;
+
+    if (!check_cpu_features())
+    {
+        printf("this cpu lacks instructions the build targets\n");
+        return 1;
+    }
+
+    if (argc < 2 || (strcmp(argv[0], "adam") != 0 && strcmp(argv[0], "local") != 0))
+    {
+        print_usage();
+        return 1;
+    }
+    Bool is_adam = strcmp(argv[0], "adam") == 0;
+    CStr filename = argv[1];
+    Int iteration_count = argc >= 3 ? atoi(argv[2]) : (is_adam ? 1000 : 20);
+    Int thread_count = argc >= 4 ? atoi(argv[3]) : get_processor_count();
+    thread_count = MAX(1, MIN(thread_count, MAX_TUNE_THREAD_COUNT));
+
+#if defined(BIT_BOARD_TABLE_ASSET)
+    Str file_contents;
+    if (!map_file("asset/bitboard.asset", &file_contents) || !deserialise_bit_board_table(file_contents, &bit_board_table))
+    {
+        printf("failed to load asset/bitboard.asset\n");
+        return 1;
+    }
+#endif
+
+    RandomGenerator random_generator;
+    random_generator.seed = 0x5eed;
+    initialize_zobrist_keys(&random_generator);
+    initialize_eval_tables();
+
+    Tuner *tuner = (Tuner *)malloc(sizeof(Tuner));
+    ASSERT(tuner);
+    UInt64 timestamp = get_current_timestamp();
+    Int skip_count;
+    if (!load_tune_positions(tuner, filename, &skip_count))
+    {
+        printf("failed to load %s\n", filename);
+        return 1;
+    }
+    if (tuner->positions.count == 0)
+    {
+        printf("no labelled positions in %s\n", filename);
+        return 1;
+    }
+    Int used_count = 0;
+    for (Int weight_i = 0; weight_i < tuner->weight_count; weight_i++)
+    {
+        used_count += tuner->weight_used[weight_i];
+    }
+    printf("loaded %d positions, skipped %d lines, %lld terms, %d of %d weights used, time %.1fs\n",
+           tuner->positions.count, skip_count, (long long)tuner->term_count, used_count, tuner->weight_count,
+           get_elapsed_time(get_current_timestamp() - timestamp));
+
+    ASSERT(initialize_tune_workers(tuner, thread_count));
+    fit_tune_k(tuner);
+    Real64 start_loss = run_tune_job(tuner, TuneJob::eval_loss);
+    printf("k %.4f  eval loss %.6f  threads %d\n", tuner->k, start_loss, thread_count);
+
+    if (is_adam)
+    {
+        run_adam(tuner, iteration_count);
+    }
+    else
+    {
+        run_local_search(tuner, iteration_count);
+    }
+
+    // NOTE: The linear values assume the phase, scale and other choices eval made with the starting weights, so the
+    // rounded weights are checked with eval itself
+    Int *weights = (Int *)malloc(tuner->weight_count * sizeof(Int));
+    for (Int weight_i = 0; weight_i < tuner->weight_count; weight_i++)
+    {
+        weights[weight_i] = (Int)round(tuner->weights[weight_i]);
+    }
+    set_eval_weights(weights);
+    Real64 end_loss = run_tune_job(tuner, TuneJob::eval_loss);
+    printf("eval loss %.6f -> %.6f\n\n", start_loss, end_loss);
+
+    Int *parameter_weights = weights;
+    for (Int parameter_i = 0; parameter_i < EVAL_PARAMETER_COUNT; parameter_i++)
+    {
+        print_eval_parameter(&eval_parameters[parameter_i], parameter_weights);
+        parameter_weights += get_eval_parameter_value_count(&eval_parameters[parameter_i]);
+    }
+    return 0;
+}
+
+#include "../lib/util.cpp"
+#include "../lib/os.cpp"